@@ -11,7 +11,10 @@
 #include "include/context.h"
 #include "include/matrix.h"
 #include "include/thread_pool.h"
+#include "include/join.h"
+#include "include/ml.h"
 #include "include/ops.h"
+#include "include/scan.h"
 
 using namespace Multitude;
 
@@ -44,8 +47,7 @@ bool verifyGeneratedFile(std::string path) {
   auto matrix = context.binaryFile(path);
   auto mBlocks = matrix->getMemoryBlocks();
   double last = -1;
-  for (auto const &entry : mBlocks) {
-    auto block = entry.second;
+  for (auto const &block : mBlocks) {
     auto &bData = block->getBlockData();
     for (int i=0; i<bData.getRows(); i++) {
       for (int j=0; j<bData.getCols(); j++) {
@@ -98,6 +100,60 @@ int main(int argc, char *argv[]) {
   auto sample0 = SAMPLE.apply(*matrix, {0, 1000}).samples;
   std::cout << "SAMPLE0=" << sample0->size() << " (" << millisSince(t0) << "ms)" << std::endl;
 
+  t0 = Time::now();
+  auto scan = std::make_shared<QueryContext>(Priority::LOW);
+  auto interactive = std::make_shared<QueryContext>(Priority::HIGH);
+  auto sumFuture = SUM.applyAsync(*matrix, {1}, scan);
+  auto maxFuture = MAX.applyAsync(*matrix, {1}, interactive);
+  auto max1 = maxFuture.get().max;
+  std::cout << "MAX1=" << max1 << " (" << millisSince(t0) << "ms)" << std::endl;
+  auto sum1 = sumFuture.get().sum;
+  std::cout << "SUM1=" << sum1 << " (" << millisSince(t0) << "ms)" << std::endl;
+
+  auto cache = std::make_shared<ResultCache>(1024);
+  SUM.setCache(cache);
+  for (int i=0; i<3; i++) {
+    t0 = Time::now();
+    auto cachedSum0 = SUM.apply(*matrix, {0}).sum;
+    std::cout << "CACHED SUM0=" << cachedSum0 << " (" << millisSince(t0)
+              << "ms)" << std::endl;
+  }
+  std::cout << "CACHE HIT RATE=" << cache->getStats().hitRate() << std::endl;
+
+  t0 = Time::now();
+  long mid = matrix->getRows() / 2;
+  auto midRow = matrix->row(mid);
+  auto window = matrix->slice(mid - 5, mid + 5);
+  std::cout << "ROW" << mid << "[0]=" << midRow[0]
+            << " SLICE=" << window.getRows() << " rows/"
+            << window.getSegments().size() << " segments"
+            << " (" << millisSince(t0) << "ms)" << std::endl;
+
+  t0 = Time::now();
+  auto cumsum0 = CUMSUM.apply(*matrix, {0});
+  std::cout << "CUMSUM0[-1]=" << cumsum0->row(cumsum0->getRows() - 1)[0]
+            << " (" << millisSince(t0) << "ms)" << std::endl;
+
+  t0 = Time::now();
+  context.save(*cumsum0, "/tmp/cumsum0.bin");
+  std::cout << "SAVED CUMSUM0 (" << millisSince(t0) << "ms)" << std::endl;
+
+  t0 = Time::now();
+  auto rollingMax0 = ROLLING_MAX.apply(*matrix, {0, 100});
+  std::cout << "ROLLINGMAX0[" << mid << "]=" << rollingMax0->row(mid)[0]
+            << " (" << millisSince(t0) << "ms)" << std::endl;
+
+  t0 = Time::now();
+  auto hist0 = HISTOGRAM.apply(*matrix, Histogram::Args::autoRange(0, 10));
+  std::cout << "HISTOGRAM0[0]=" << (*hist0.counts)[0] << " ("
+            << millisSince(t0) << "ms)" << std::endl;
+
+  t0 = Time::now();
+  auto kmeans0 = KMEANS.apply(*matrix, KMeans::Args({0}, 4, 20));
+  std::cout << "KMEANS0 inertia=" << kmeans0.inertia << " after "
+            << kmeans0.iterations << " iterations (" << millisSince(t0)
+            << "ms)" << std::endl;
+
   t0 = Time::now();
   std::sort(sample0->begin(), sample0->end());
   std::vector<double> percentiles;
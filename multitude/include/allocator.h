@@ -0,0 +1,96 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Multitude {
+
+/**
+ * Huge page policy for large block buffers.
+ */
+enum class HugePages {
+  NONE,         ///< Regular pages.
+  TRANSPARENT,  ///< Ask for transparent huge pages (madvise).
+  EXPLICIT      ///< Use reserved huge pages, else transparent ones.
+};
+
+/**
+ * Releases a block buffer. Buffers from BlockAllocator remember their
+ * capacity and go back to its pool; a capacity of zero marks a buffer
+ * allocated with new[].
+ */
+struct BufferDeleter {
+  BufferDeleter(size_t bytes = 0) : bytes(bytes) {}
+  void operator()(double* data) const;
+  size_t bytes;  ///< Capacity of the buffer in bytes.
+};
+
+/// Owning pointer to a block's matrix data.
+typedef std::unique_ptr<double[], BufferDeleter> BlockBuffer;
+
+/**
+ * Allocator for block buffers.
+ *
+ * Buffers are not initialized. Buffers of at least 2MB are mapped
+ * directly, 2MB aligned and rounded to whole huge pages, so they can
+ * be backed by huge pages; smaller ones are 64-byte (cache line)
+ * aligned. Released buffers are kept in a pool (up to a byte limit)
+ * and reused for requests that need at least 4/5 of their capacity,
+ * so reloading or recomputing similar blocks skips page faults
+ * entirely.
+ */
+class BlockAllocator {
+ public:
+  /// Process-wide allocator used for all block buffers.
+  static BlockAllocator& instance();
+
+  /**
+   * Allocate an uninitialized buffer.
+   *
+   * @param doubles - Number of doubles the buffer must hold.
+   * @return - Owning buffer which returns to the pool when freed.
+   */
+  BlockBuffer allocate(size_t doubles);
+
+  /**
+   * Return a buffer to the pool (or to the system if the pool is full).
+   *
+   * @param data - Buffer from allocate().
+   * @param bytes - Capacity of the buffer.
+   */
+  void release(double* data, size_t bytes);
+
+  /// Huge page policy for buffers mapped from now on.
+  void setHugePages(HugePages mode);
+
+  /// Maximum number of bytes kept in the pool (default 64MB).
+  void setMaxPooledBytes(size_t bytes);
+
+  /// Bytes currently held in the pool.
+  size_t getPooledBytes();
+
+  /// Return all pooled buffers to the system.
+  void trim();
+
+ private:
+  BlockAllocator();
+  BlockAllocator(BlockAllocator const&) = delete;
+  void operator=(BlockAllocator const&) = delete;
+
+  void* map(size_t bytes);
+  void unmap(void* data, size_t bytes);
+
+  std::mutex mutex;
+  HugePages hugePages;
+  size_t maxPooledBytes;
+  size_t pooledBytes;
+  std::map<size_t, std::vector<void*>> pool;
+};
+
+}
+
+#endif
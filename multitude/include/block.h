@@ -1,12 +1,26 @@
 #ifndef BLOCK_H
 #define BLOCK_H
 
+#include <algorithm>
+#include <cmath>
 #include <future>
+#include <limits>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include "allocator.h"
 
 namespace Multitude {
 
+/**
+ * Determine the next unique block ID. IDs are small integers
+ * assigned in increasing order for the lifetime of the process.
+ *
+ * @return - Unique block identifier.
+ */
+long nextBlockId();
+
 /**
  * Represents a location of a chunk of data in a file.
  */
@@ -16,13 +30,13 @@ class DataLocation {
       : path(path), offset(offset), length(length) {}
 
   /// Path to file containing block's data.
-  std::string getPath() { return path; }
+  std::string getPath() const { return path; }
 
   /// Byte offset in file.
-  long getOffset() { return offset; }
+  long getOffset() const { return offset; }
 
   /// Length of block data in bytes.
-  long getLength() { return length; }
+  long getLength() const { return length; }
 
  private:
   std::string path;
@@ -42,6 +56,13 @@ class BlockDescriptor {
   /// Location of block's matrix data.
   DataLocation& getLocation() { return *location; }
 
+  /// Location of block's matrix data.
+  const DataLocation& getLocation() const { return *location; }
+
+  /// Whether the block is backed by a file location (computed blocks
+  /// exist only in memory).
+  bool hasLocation() const { return location != nullptr; }
+
  private:
   std::shared_ptr<DataLocation> location;
 };
@@ -51,9 +72,12 @@ class BlockDescriptor {
  */
 class BlockData {
  public:
-  BlockData(long rows, long cols, std::unique_ptr<double[]> data)
+  BlockData(long rows, long cols, BlockBuffer data)
       : rows(rows), cols(cols), data(std::move(data)) {}
 
+  BlockData(long rows, long cols, std::unique_ptr<double[]> data)
+      : rows(rows), cols(cols), data(data.release()) {}
+
   /// Number of rows in this block.
   long getRows() const { return rows; }
 
@@ -66,7 +90,18 @@ class BlockData {
  private:
   long rows;
   long cols;
-  std::unique_ptr<double[]> data;
+  BlockBuffer data;
+};
+
+/**
+ * Summary statistics of one column of a block.
+ */
+struct ColumnStats {
+  ColumnStats(double min, double max, double minPositive)
+      : min(min), max(max), minPositive(minPositive) {}
+  const double min;          ///< Smallest value (+inf if there are none).
+  const double max;          ///< Largest value (-inf if there are none).
+  const double minPositive;  ///< Smallest value > 0 (+inf if none).
 };
 
 /**
@@ -74,13 +109,18 @@ class BlockData {
  */
 class MemoryBlock {
  public:
-  MemoryBlock(std::string id, std::unique_ptr<BlockDescriptor> descriptor,
+  MemoryBlock(long id, std::unique_ptr<BlockDescriptor> descriptor,
               std::unique_ptr<BlockData> blockData)
       : id(id), descriptor(std::move(descriptor)),
         blockData(std::move(blockData)) {}
 
+  /// Block computed in memory, with no backing file location.
+  MemoryBlock(long id, std::unique_ptr<BlockData> blockData)
+      : id(id), descriptor(std::make_unique<BlockDescriptor>(nullptr)),
+        blockData(std::move(blockData)) {}
+
   /// Unique block identifier.
-  std::string getId() { return id; }
+  long getId() const { return id; }
 
   /// Descriptor of block's data.
   const BlockDescriptor& getDescriptor() const { return *descriptor; }
@@ -88,10 +128,46 @@ class MemoryBlock {
   /// Immutable view of block's matrix data.
   const BlockData& getBlockData() const { return *blockData; }
 
+  /**
+   * Statistics of a column, ignoring NaNs. Computed on first use and
+   * kept, since block data never changes.
+   *
+   * @param col - Column index.
+   * @return - Column statistics.
+   */
+  ColumnStats getColumnStats(int col) const {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    auto it = stats.find(col);
+    if (it != stats.end()) {
+      return it->second;
+    }
+
+    double min = std::numeric_limits<double>::infinity();
+    double max = -min;
+    double minPositive = min;
+    const double* data = blockData->getData();
+    for (long i=0; i<blockData->getRows(); i++) {
+      double value = data[i * blockData->getCols() + col];
+      if (!std::isnan(value)) {
+        min = std::min(min, value);
+        max = std::max(max, value);
+        if (value > 0) {
+          minPositive = std::min(minPositive, value);
+        }
+      }
+    }
+
+    ColumnStats columnStats(min, max, minPositive);
+    stats.emplace(col, columnStats);
+    return columnStats;
+  }
+
  private:
-  std::string id;
+  long id;
   std::unique_ptr<BlockDescriptor> descriptor;
   std::unique_ptr<BlockData> blockData;
+  mutable std::mutex statsMutex;
+  mutable std::map<int, ColumnStats> stats;
 };
 
 /**
@@ -99,7 +175,7 @@ class MemoryBlock {
  */
 class RemoteBlock {
  public:
-  RemoteBlock(std::string id, std::unique_ptr<BlockDescriptor> descriptor)
+  RemoteBlock(long id, std::unique_ptr<BlockDescriptor> descriptor)
       : id(id), descriptor(std::move(descriptor)) {}
 
   template<typename T>
@@ -110,11 +186,11 @@ class RemoteBlock {
   std::future<RemoteBlock> transform(std::shared_ptr<T> op,
                                      typename T::Args& opArgs);
 
-  std::string getId() { return id; }
+  long getId() const { return id; }
   const BlockDescriptor& getDescriptor() const { return *descriptor; }
 
  private:
-  std::string id;
+  long id;
   std::unique_ptr<BlockDescriptor> descriptor;
 };
 
@@ -0,0 +1,231 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Multitude {
+
+/**
+ * Spread the bits of a value (splitmix64 finalizer).
+ */
+inline size_t hashMix(uint64_t h) {
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+  return h ^ (h >> 31);
+}
+
+/**
+ * Mix a value into a hash (boost::hash_combine of the mixed value, so
+ * small integer fields, whose std::hash is the identity, do not
+ * cancel out).
+ */
+inline size_t hashCombine(size_t seed, size_t value) {
+  return seed ^ (hashMix(value) + 0x9e3779b97f4a7c15ULL + (seed << 6) +
+                 (seed >> 2));
+}
+
+/**
+ * Operation and args a cached result was computed with. The hash only
+ * buckets entries; tags are compared by value on lookup.
+ */
+class CacheTag {
+ public:
+  CacheTag(size_t hash) : hash(hash) {}
+  virtual ~CacheTag() {}
+
+  size_t getHash() const { return hash; }
+
+  /// Whether other names the same operation and equal args.
+  virtual bool equals(const CacheTag& other) const = 0;
+
+ private:
+  const size_t hash;
+};
+
+/**
+ * Tag of operation Op with a copy of its args; Args must define
+ * operator==.
+ */
+template<typename Op, typename Args>
+class ArgsTag : public CacheTag {
+ public:
+  ArgsTag(const Args& args, size_t argsHash)
+      : CacheTag(hashCombine(typeid(Op).hash_code(), argsHash)), args(args) {}
+
+  bool equals(const CacheTag& other) const override {
+    auto tag = dynamic_cast<const ArgsTag*>(&other);
+    return tag != nullptr && tag->args == args;
+  }
+
+ private:
+  const Args args;
+};
+
+/**
+ * Identifies the result of one operation applied to one block.
+ */
+struct CacheKey {
+  CacheKey(long blockId, std::shared_ptr<const CacheTag> tag)
+      : blockId(blockId), tag(tag) {}
+
+  bool operator==(const CacheKey& other) const {
+    return blockId == other.blockId &&
+        (tag == other.tag || (tag->getHash() == other.tag->getHash() &&
+                              tag->equals(*other.tag)));
+  }
+
+  long blockId;                          ///< Unique id of the block.
+  std::shared_ptr<const CacheTag> tag;   ///< Operation and args.
+};
+
+struct CacheKeyHash {
+  size_t operator()(const CacheKey& key) const {
+    return hashCombine(std::hash<long>()(key.blockId), key.tag->getHash());
+  }
+};
+
+/**
+ * Counters of a ResultCache.
+ */
+struct CacheStats {
+  long hits;       ///< Lookups that found a result.
+  long misses;     ///< Lookups that found nothing.
+  long evictions;  ///< Results dropped to stay within capacity.
+  long entries;    ///< Results currently cached.
+
+  /// Fraction of lookups that were hits.
+  double hitRate() const {
+    return hits + misses == 0 ? 0 : (double)hits / (hits + misses);
+  }
+};
+
+/**
+ * Size-bounded cache of per-block operation results, shared by any
+ * number of operations (see ValueOperation::setCache and
+ * StandingOperation). Entries are split over independently locked
+ * shards, each evicting its least recently used results, so
+ * concurrent block tasks rarely contend.
+ *
+ * Blocks are immutable and block ids are never reused, so cached
+ * results never need invalidation.
+ */
+class ResultCache {
+ public:
+  /**
+   * @param capacity - Maximum number of cached block results.
+   * @param numShards - Number of independently locked shards.
+   */
+  ResultCache(size_t capacity, size_t numShards = 16)
+      : hits(0), misses(0), evictions(0) {
+    capacity = std::max<size_t>(1, capacity);
+    numShards = std::max<size_t>(1, std::min(numShards, capacity));
+    shardCapacity = capacity / numShards;
+    for (size_t i=0; i<numShards; i++) {
+      shards.push_back(std::make_unique<Shard>());
+    }
+  }
+
+  /**
+   * Look up a cached result.
+   *
+   * @param key - Block, operation and args.
+   * @return - Cached result, or null on a miss.
+   */
+  std::shared_ptr<const void> lookup(const CacheKey& key) {
+    Shard &shard = shardOf(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+      misses++;
+      return nullptr;
+    }
+
+    hits++;
+    shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+    return it->second->second;
+  }
+
+  /**
+   * Cache a result, evicting the shard's least recently used result
+   * if it is full.
+   *
+   * @param key - Block, operation and args.
+   * @param value - Result to cache.
+   */
+  void insert(const CacheKey& key, std::shared_ptr<const void> value) {
+    Shard &shard = shardOf(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+      it->second->second = value;
+      shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+      return;
+    }
+
+    shard.entries.emplace_front(key, value);
+    shard.index.emplace(key, shard.entries.begin());
+    if (shard.entries.size() > shardCapacity) {
+      shard.index.erase(shard.entries.back().first);
+      shard.entries.pop_back();
+      evictions++;
+    }
+  }
+
+  /// Drop all cached results (counters are kept).
+  void clear() {
+    for (auto &shard : shards) {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      shard->entries.clear();
+      shard->index.clear();
+    }
+  }
+
+  /// Current hit/miss/eviction counters.
+  CacheStats getStats() {
+    long entries = 0;
+    for (auto &shard : shards) {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      entries += shard->entries.size();
+    }
+    return {hits, misses, evictions, entries};
+  }
+
+ private:
+  ResultCache(ResultCache const&) = delete;
+  void operator=(ResultCache const&) = delete;
+
+  typedef std::list<std::pair<CacheKey, std::shared_ptr<const void>>> Entries;
+
+  /**
+   * LRU list of results and its index.
+   */
+  struct Shard {
+    std::mutex mutex;
+    Entries entries;
+    std::unordered_map<CacheKey, Entries::iterator, CacheKeyHash> index;
+  };
+
+  Shard& shardOf(const CacheKey& key) {
+    return *shards[CacheKeyHash()(key) % shards.size()];
+  }
+
+  size_t shardCapacity;
+  std::vector<std::unique_ptr<Shard>> shards;
+  std::atomic<long> hits;
+  std::atomic<long> misses;
+  std::atomic<long> evictions;
+};
+
+}
+
+#endif
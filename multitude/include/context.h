@@ -3,16 +3,44 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 #include "matrix.h"
 
 namespace Multitude {
 
+/**
+ * Durability of a saved matrix file.
+ */
+enum class SyncPolicy {
+  NONE,  ///< Leave flushing to the operating system.
+  DATA,  ///< fdatasync the file before it is renamed into place.
+  FULL   ///< fsync the file and, after the rename, its directory.
+};
+
 /**
  * Distributed system context, used to load/save matrices.
  */
 class DContext {
  public:
+  /**
+   * @param maxConcurrentReads - Maximum number of block reads in
+   *                             flight while loading (0: one per core).
+   */
+  DContext(int maxConcurrentReads = 0);
+
   std::unique_ptr<DMatrix> binaryFile(std::string path);
+
+  std::unique_ptr<DMatrix> binaryFiles(std::vector<std::string> paths);
+
+  std::unique_ptr<DMatrix> shardedFiles(std::string pattern);
+
+  long refresh(DMatrix& matrix);
+
+  void save(DMatrix& matrix, std::string path,
+            SyncPolicy sync = SyncPolicy::NONE, bool atomic = true);
+
+ private:
+  int maxConcurrentReads;
 };
 
 }
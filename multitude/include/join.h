@@ -0,0 +1,377 @@
+#ifndef JOIN_H
+#define JOIN_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "allocator.h"
+#include "matrix.h"
+#include "ops.h"
+#include "thread_pool.h"
+
+namespace Multitude {
+
+/**
+ * Strategy used by JoinOperation.
+ */
+enum class JoinMode {
+  /// Build one table split into a few partitions (for a parallel
+  /// build) and probe it from every probe block in parallel. Output
+  /// follows probe row order.
+  PARTITIONED,
+
+  /// Radix-partition both sides into many partitions small enough
+  /// for their table to stay in cache, then build and probe each
+  /// partition together. Use when the build side does not fit in
+  /// cache; output order is unspecified.
+  RADIX
+};
+
+/**
+ * Chained hash table over the build rows of one partition. Entry
+ * chains keep build row order, so duplicate keys join in order.
+ */
+class JoinTable {
+ public:
+  /// Build row reference with its key and hash.
+  struct Entry {
+    Entry(long key, uint64_t hash, const double* row)
+        : key(key), hash(hash), row(row) {}
+    long key;
+    uint64_t hash;
+    const double* row;
+  };
+
+  /**
+   * Index a partition's entries.
+   *
+   * @param entries - Entries of the partition, in build row order.
+   */
+  void build(std::vector<Entry> entries) {
+    this->entries = std::move(entries);
+
+    size_t buckets = 1;
+    while (buckets < 2 * this->entries.size()) {
+      buckets <<= 1;
+    }
+    mask = buckets - 1;
+    heads.assign(buckets, -1);
+    next.assign(this->entries.size(), -1);
+
+    for (size_t i=this->entries.size(); i-- > 0;) {
+      size_t bucket = this->entries[i].hash & mask;
+      next[i] = heads[bucket];
+      heads[bucket] = i;
+    }
+  }
+
+  /**
+   * Call emit(row) for every build row matching a key.
+   */
+  template<typename F>
+  void probe(long key, uint64_t hash, F emit) const {
+    for (long i = heads[hash & mask]; i >= 0; i = next[i]) {
+      if (entries[i].key == key) {
+        emit(entries[i].row);
+      }
+    }
+  }
+
+ private:
+  std::vector<Entry> entries;
+  std::vector<long> heads;
+  std::vector<long> next;
+  uint64_t mask;
+};
+
+/**
+ * Inner equi-join of two distributed matrices on integer-valued key
+ * columns. The build side (normally the smaller matrix) is hashed in
+ * parallel into a partitioned table which is probed in parallel from
+ * the blocks of the probe side.
+ *
+ * Each output row holds all columns of the probe row followed by the
+ * columns of the matching build row without its key column. Keys must
+ * be integral; NaN, infinite, fractional and out-of-range keys never
+ * match.
+ */
+class JoinOperation {
+ public:
+  struct Args {
+    Args(int probeCol, int buildCol, JoinMode mode = JoinMode::PARTITIONED,
+         int radixBits = 0)
+        : probeCol(probeCol), buildCol(buildCol), mode(mode),
+          radixBits(radixBits) {}
+    const int probeCol;
+    const int buildCol;
+    const JoinMode mode;
+    const int radixBits;  ///< RADIX partition bits; 0 picks from build size.
+  };
+
+  /**
+   * Join probe with build.
+   *
+   * @param probe - Larger (fact) matrix, scanned block by block.
+   * @param build - Smaller (dimension) matrix, hashed.
+   * @param args - Key columns and join mode.
+   * @param context - Query priority and cancellation handle.
+   * @return - Matrix of joined rows.
+   */
+  std::unique_ptr<DMatrix> apply(DMatrix& probe, DMatrix& build, Args args,
+                                 std::shared_ptr<QueryContext> context =
+                                     std::make_shared<QueryContext>()) {
+    validate(probe, build, args);
+    int bits = partitionBits(build, args);
+    size_t partitions = size_t(1) << bits;
+
+    // Scatter build rows into per-block partition lists.
+    auto const &buildBlocks = build.getMemoryBlocks();
+    std::vector<std::vector<std::vector<JoinTable::Entry>>> scattered(
+        buildBlocks.size());
+    pool.parallelFor(context, buildBlocks.size(), [&](size_t b) {
+        scattered[b] = scatter(*buildBlocks[b], args.buildCol, bits);
+      });
+
+    if (args.mode == JoinMode::RADIX) {
+      return radixJoin(probe, build, args, bits, scattered, context);
+    }
+
+    std::vector<JoinTable> tables(partitions);
+    pool.parallelFor(context, partitions, [&](size_t p) {
+        tables[p].build(gather(scattered, p));
+      });
+
+    auto const &probeBlocks = probe.getMemoryBlocks();
+    std::vector<std::shared_ptr<MemoryBlock>> outBlocks(probeBlocks.size());
+    pool.parallelFor(context, probeBlocks.size(), [&](size_t b) {
+        auto const &blockData = probeBlocks[b]->getBlockData();
+        auto const data = blockData.getData();
+        long cols = blockData.getCols();
+
+        std::vector<double> out;
+        for (long i=0; i<blockData.getRows(); i++) {
+          const double* row = data + i * cols;
+          long key;
+          if (!toKey(row[args.probeCol], key)) {
+            continue;
+          }
+
+          uint64_t hash = hashKey(key);
+          tables[partitionOf(hash, bits)].probe(key, hash, [&](const double* match) {
+              emit(out, row, cols, match, build.getCols(), args.buildCol);
+            });
+        }
+        outBlocks[b] = joinedBlock(out, cols + build.getCols() - 1);
+      });
+
+    return toMatrix(outBlocks, joinedCols(probe, build));
+  }
+
+ private:
+  /**
+   * Reject key columns outside either matrix. A side whose column
+   * count is unknown has no blocks and joins to nothing, so it is not
+   * checked.
+   */
+  static void validate(DMatrix& probe, DMatrix& build, const Args& args) {
+    if (probe.getCols() > 0 &&
+        (args.probeCol < 0 || args.probeCol >= probe.getCols())) {
+      throw std::invalid_argument("probe key column out of range");
+    } else if (build.getCols() > 0 &&
+               (args.buildCol < 0 || args.buildCol >= build.getCols())) {
+      throw std::invalid_argument("build key column out of range");
+    }
+  }
+
+  /**
+   * Convert a key column value to an integer key; false if the value
+   * is not an integer representable as a long.
+   */
+  static bool toKey(double value, long& key) {
+    // 2^63 is exact as a double; long covers [-2^63, 2^63).
+    const double limit = 9223372036854775808.0;
+    if (!std::isfinite(value) || value != std::trunc(value) ||
+        value < -limit || value >= limit) {
+      return false;
+    }
+    key = static_cast<long>(value);
+    return true;
+  }
+
+  /**
+   * Hash of a key; partitions use the high bits, buckets the low bits.
+   */
+  static uint64_t hashKey(long key) {
+    return hashMix(static_cast<uint64_t>(key));
+  }
+
+  static size_t partitionOf(uint64_t hash, int bits) {
+    return bits == 0 ? 0 : hash >> (64 - bits);
+  }
+
+  /**
+   * Number of partition bits: enough partitions for a parallel build
+   * in PARTITIONED mode, or enough to keep each partition's table
+   * (~8K rows) in cache in RADIX mode.
+   */
+  static int partitionBits(DMatrix& build, const Args& args) {
+    if (args.mode == JoinMode::RADIX && args.radixBits > 0) {
+      return std::min(args.radixBits, 16);
+    }
+
+    long target = 4L * std::max(1U, std::thread::hardware_concurrency());
+    if (args.mode == JoinMode::RADIX) {
+      target = std::max(target, build.getRows() / 8192);
+    }
+
+    int bits = 0;
+    while ((1L << bits) < target && bits < 12) {
+      bits++;
+    }
+    return bits;
+  }
+
+  /**
+   * Split the rows of a block into per-partition entry lists.
+   */
+  static std::vector<std::vector<JoinTable::Entry>> scatter(
+      const MemoryBlock& block, int col, int bits) {
+    std::vector<std::vector<JoinTable::Entry>> parts(size_t(1) << bits);
+    auto const &blockData = block.getBlockData();
+    auto const data = blockData.getData();
+    for (long i=0; i<blockData.getRows(); i++) {
+      const double* row = data + i * blockData.getCols();
+      long key;
+      if (!toKey(row[col], key)) {
+        continue;
+      }
+
+      uint64_t hash = hashKey(key);
+      parts[partitionOf(hash, bits)].push_back({key, hash, row});
+    }
+    return parts;
+  }
+
+  /**
+   * Concatenate one partition's entries across blocks, in block order.
+   */
+  static std::vector<JoinTable::Entry> gather(
+      const std::vector<std::vector<std::vector<JoinTable::Entry>>>& scattered,
+      size_t p) {
+    size_t size = 0;
+    for (auto const &parts : scattered) {
+      size += parts[p].size();
+    }
+
+    std::vector<JoinTable::Entry> entries;
+    entries.reserve(size);
+    for (auto const &parts : scattered) {
+      entries.insert(entries.end(), parts[p].begin(), parts[p].end());
+    }
+    return entries;
+  }
+
+  /**
+   * Build and probe each radix partition in turn, so a partition's
+   * table is still in cache while it is probed. Partitions are
+   * handed out in contiguous ranges, one output block per range.
+   */
+  std::unique_ptr<DMatrix> radixJoin(
+      DMatrix& probe, DMatrix& build, const Args& args, int bits,
+      std::vector<std::vector<std::vector<JoinTable::Entry>>>& buildParts,
+      std::shared_ptr<QueryContext> context) {
+    size_t partitions = size_t(1) << bits;
+
+    auto const &probeBlocks = probe.getMemoryBlocks();
+    std::vector<std::vector<std::vector<JoinTable::Entry>>> probeParts(
+        probeBlocks.size());
+    pool.parallelFor(context, probeBlocks.size(), [&](size_t b) {
+        probeParts[b] = scatter(*probeBlocks[b], args.probeCol, bits);
+      });
+
+    long probeCols = probe.getCols();
+    size_t ranges = std::min<size_t>(
+        partitions, std::max(1U, std::thread::hardware_concurrency()));
+    std::vector<std::shared_ptr<MemoryBlock>> outBlocks(ranges);
+    pool.parallelFor(context, ranges, [&](size_t r) {
+        std::vector<double> out;
+        JoinTable table;
+        for (size_t p = r * partitions / ranges;
+             p < (r + 1) * partitions / ranges; p++) {
+          table.build(gather(buildParts, p));
+          for (auto const &parts : probeParts) {
+            for (auto const &entry : parts[p]) {
+              table.probe(entry.key, entry.hash, [&](const double* match) {
+                  emit(out, entry.row, probeCols, match, build.getCols(),
+                       args.buildCol);
+                });
+            }
+          }
+        }
+        outBlocks[r] = joinedBlock(out, probeCols + build.getCols() - 1);
+      });
+
+    return toMatrix(outBlocks, joinedCols(probe, build));
+  }
+
+  /**
+   * Append a joined row: the probe row, then the build row minus its key.
+   */
+  static void emit(std::vector<double>& out, const double* probeRow,
+                   long probeCols, const double* buildRow, long buildCols,
+                   int buildCol) {
+    out.insert(out.end(), probeRow, probeRow + probeCols);
+    out.insert(out.end(), buildRow, buildRow + buildCol);
+    out.insert(out.end(), buildRow + buildCol + 1, buildRow + buildCols);
+  }
+
+  /**
+   * Wrap joined rows as a memory block; empty results produce no block.
+   */
+  static std::shared_ptr<MemoryBlock> joinedBlock(
+      const std::vector<double>& out, long cols) {
+    if (out.empty()) {
+      return nullptr;
+    }
+
+    BlockBuffer data = BlockAllocator::instance().allocate(out.size());
+    std::copy(out.begin(), out.end(), data.get());
+    auto blockData = std::make_unique<BlockData>(out.size() / cols, cols,
+                                                 std::move(data));
+    return std::make_shared<MemoryBlock>(nextBlockId(), std::move(blockData));
+  }
+
+  /**
+   * Columns of a joined row (0 if either side's columns are unknown).
+   */
+  static long joinedCols(DMatrix& probe, DMatrix& build) {
+    if (probe.getCols() <= 0 || build.getCols() <= 0) {
+      return 0;
+    }
+    return probe.getCols() + build.getCols() - 1;
+  }
+
+  static std::unique_ptr<DMatrix> toMatrix(
+      const std::vector<std::shared_ptr<MemoryBlock>>& outBlocks, long cols) {
+    std::vector<std::shared_ptr<MemoryBlock>> blocks;
+    for (auto const &block : outBlocks) {
+      if (block) {
+        blocks.push_back(block);
+      }
+    }
+
+    std::vector<std::shared_ptr<RemoteBlock>> empty;
+    return std::make_unique<DMatrix>(blocks, empty, cols);
+  }
+};
+
+
+JoinOperation JOIN;
+
+}
+
+#endif
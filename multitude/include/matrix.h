@@ -1,38 +1,192 @@
 #ifndef MATRIX_H
 #define MATRIX_H
 
-#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 #include "block.h"
 
 namespace Multitude {
 
+/**
+ * Zero-copy view of a single matrix row.
+ */
+class RowView {
+ public:
+  RowView(const double* data, long cols) : data(data), cols(cols) {}
+
+  /// Number of columns in the row.
+  long getCols() const { return cols; }
+
+  /// Immutable view of the row's values.
+  const double* getData() const { return data; }
+
+  /// Value of a column in the row.
+  double operator[](long col) const { return data[col]; }
+
+ private:
+  const double* data;
+  long cols;
+};
+
+/**
+ * Contiguous run of rows within one memory block.
+ */
+class BlockSegment {
+ public:
+  BlockSegment(std::shared_ptr<MemoryBlock> block, long firstRow, long rows)
+      : block(block), firstRow(firstRow), rows(rows) {}
+
+  /// Block containing the rows.
+  const MemoryBlock& getBlock() const { return *block; }
+
+  /// Index of the segment's first row within the block.
+  long getFirstRow() const { return firstRow; }
+
+  /// Number of rows in the segment.
+  long getRows() const { return rows; }
+
+  /// Immutable view of the segment's matrix data (row-major).
+  const double* getData() const {
+    auto const &blockData = block->getBlockData();
+    return blockData.getData() + firstRow * blockData.getCols();
+  }
+
+ private:
+  std::shared_ptr<MemoryBlock> block;
+  long firstRow;
+  long rows;
+};
+
+/**
+ * Zero-copy view of a range of rows of a distributed matrix. The
+ * rows may span several blocks; the view keeps those blocks alive.
+ */
+class MatrixSlice {
+ public:
+  MatrixSlice(std::vector<BlockSegment> segments, long cols);
+
+  /// Number of rows in the slice.
+  long getRows() const { return rows; }
+
+  /// Number of columns in the slice.
+  long getCols() const { return cols; }
+
+  /// Segments making up the slice, in row order.
+  const std::vector<BlockSegment>& getSegments() const { return segments; }
+
+  /// View of the i-th row of the slice.
+  RowView row(long i) const;
+
+ private:
+  std::vector<BlockSegment> segments;
+  std::vector<long> startRows;
+  long rows;
+  long cols;
+};
+
+/**
+ * File a matrix was loaded from and how far into it rows were loaded.
+ */
+struct SourceFile {
+  SourceFile(std::string path, long end) : path(path), end(end) {}
+  std::string path;
+  long end;  ///< Byte offset just past the last loaded row.
+};
+
 /**
  * Distributed matrix represented as a collection of "blocks". Each
  * block contains a sequential subset of the rows in the
  * matrix. Blocks can be local to the current program (memory blocks)
  * or located in another process potentially running on another
  * machine (network blocks, not implemented yet).
+ *
+ * Memory blocks are kept in row order and indexed by the global
+ * row at which they start, so locating a row never touches more
+ * than a few blocks.
  */
 class DMatrix {
  public:
+  /**
+   * @param memoryBlocks - Memory blocks in row order.
+   * @param remoteBlocks - Network blocks.
+   * @param cols - Number of columns; taken from the first memory block
+   *               when there is one, so it only matters for matrices
+   *               without memory blocks (0: unknown).
+   */
   DMatrix(std::vector<std::shared_ptr<MemoryBlock>> memoryBlocks,
-          std::vector<std::shared_ptr<RemoteBlock>> remoteBlocks);
+          std::vector<std::shared_ptr<RemoteBlock>> remoteBlocks,
+          long cols = 0);
 
-  /// Map of all memory blocks indexed by their unique block ID.
-  std::map<std::string, std::shared_ptr<MemoryBlock>> getMemoryBlocks() {
+  /// All memory blocks in row order.
+  const std::vector<std::shared_ptr<MemoryBlock>>& getMemoryBlocks() const {
     return memoryBlocks;
   }
 
-  /// Map of all network blocks indexed by their unique block ID.
-  std::map<std::string, std::shared_ptr<RemoteBlock>> getRemoteBlocks() {
+  /**
+   * Replace the memory blocks (e.g. after appending new rows) and
+   * rebuild the row index. Must not run concurrently with operations
+   * on the matrix.
+   *
+   * @param memoryBlocks - New memory blocks in row order.
+   */
+  void setMemoryBlocks(std::vector<std::shared_ptr<MemoryBlock>> memoryBlocks);
+
+  /// Files the matrix was loaded from, in row order (empty if computed).
+  const std::vector<SourceFile>& getSources() const { return sources; }
+
+  /// Replace the source files (e.g. after loading appended rows).
+  void setSources(std::vector<SourceFile> sources) { this->sources = sources; }
+
+  /// All network blocks.
+  const std::vector<std::shared_ptr<RemoteBlock>>& getRemoteBlocks() const {
     return remoteBlocks;
   }
 
+  /// Global index of the first row of the i-th memory block.
+  long getStartRow(size_t block) const { return startRows[block]; }
+
+  /// Total number of rows in the memory blocks.
+  long getRows() const { return rows; }
+
+  /// Number of columns in the matrix (0 if unknown).
+  long getCols() const { return cols; }
+
+  /**
+   * Index of the memory block containing a global row.
+   *
+   * @param i - Global row index.
+   * @return - Position of the block in getMemoryBlocks().
+   */
+  size_t findBlock(long i) const;
+
+  /**
+   * View of a single row.
+   *
+   * @param i - Global row index.
+   * @return - Zero-copy row view.
+   */
+  RowView row(long i) const;
+
+  /**
+   * View of the rows [begin, end), possibly spanning several blocks.
+   *
+   * @param begin - First global row of the slice.
+   * @param end - One past the last global row of the slice.
+   * @return - Zero-copy slice.
+   */
+  MatrixSlice slice(long begin, long end) const;
+
  private:
-  std::map<std::string, std::shared_ptr<MemoryBlock>> memoryBlocks;
-  std::map<std::string, std::shared_ptr<RemoteBlock>> remoteBlocks;
+  void index();
+
+  std::vector<std::shared_ptr<MemoryBlock>> memoryBlocks;
+  std::vector<std::shared_ptr<RemoteBlock>> remoteBlocks;
+  std::vector<SourceFile> sources;
+  std::vector<long> startRows;
+  long uniformRows;
+  long rows;
+  long cols;
 };
 
 }
@@ -0,0 +1,467 @@
+#ifndef ML_H
+#define ML_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <vector>
+#include "matrix.h"
+#include "ops.h"
+#include "thread_pool.h"
+
+namespace Multitude {
+
+/**
+ * Iterative operation on a distributed matrix: a model is refined over
+ * several passes over the resident blocks. Every iteration broadcasts
+ * the current (small) model to all blocks, each block accumulates into
+ * its own scratch partial (allocated once and reused across
+ * iterations), the partials are merged with a parallel tree reduction
+ * and the merged partial updates the model.
+ *
+ * The templated type, T, must have the following traits:
+ *   1. Define nested types Args, Model and Partial; Args has an
+ *      `iterations` member (maximum number of iterations).
+ *   2. Define function init(matrix, args, context): initial model.
+ *   3. Define function makePartial(matrix, block, args, model): scratch
+ *      for the block at index `block`.
+ *   4. Define function reset(partial): clear a partial for reuse.
+ *   5. Define function accumulate(block, args, model, iteration,
+ *      partial): add one block's contribution.
+ *   6. Define function merge(into, from): add a partial into another.
+ *   7. Define function update(model, total, args, iteration): apply
+ *      the merged partial; returns true once converged.
+ */
+template<typename T>
+class IterativeOperation {
+ public:
+  /**
+   * Run the templated operation to convergence (or args.iterations).
+   *
+   * @param matrix - Matrix to train on.
+   * @param args - Operation arguments.
+   * @param context - Query priority and cancellation handle.
+   * @return - Final model.
+   */
+  typename T::Model apply(DMatrix& matrix, typename T::Args args,
+                          std::shared_ptr<QueryContext> context =
+                              std::make_shared<QueryContext>()) {
+    auto const &blocks = matrix.getMemoryBlocks();
+    typename T::Model model = t.init(matrix, args, context);
+
+    std::vector<typename T::Partial> partials;
+    for (size_t i=0; i<blocks.size(); i++) {
+      partials.push_back(t.makePartial(matrix, i, args, model));
+    }
+
+    for (long iteration=0; iteration<args.iterations; iteration++) {
+      pool.parallelFor(context, blocks.size(), [&](size_t i) {
+          t.reset(partials[i]);
+          t.accumulate(*blocks[i], args, model, iteration, partials[i]);
+        });
+
+      reduce(partials, context);
+      if (partials.empty() || t.update(model, partials[0], args, iteration)) {
+        break;
+      }
+    }
+
+    return model;
+  }
+
+ private:
+  /**
+   * Merge all partials into partials[0], pairwise in log2(n) parallel
+   * rounds.
+   */
+  void reduce(std::vector<typename T::Partial>& partials,
+              std::shared_ptr<QueryContext> context) {
+    for (size_t stride=1; stride<partials.size(); stride*=2) {
+      size_t pairs = (partials.size() - stride + 2 * stride - 1) / (2 * stride);
+      pool.parallelFor(context, pairs, [&](size_t p) {
+          size_t i = p * 2 * stride;
+          t.merge(partials[i], partials[i + stride]);
+        });
+    }
+  }
+
+  T t;
+};
+
+/**
+ * Copy the feature columns of a row into a dense vector.
+ */
+inline void gatherFeatures(const double* row, const std::vector<int>& cols,
+                           double* out) {
+  for (size_t j=0; j<cols.size(); j++) {
+    out[j] = row[cols[j]];
+  }
+}
+
+/**
+ * Lloyd's k-means over feature columns, initialized with k-means++.
+ */
+class KMeans {
+ public:
+  struct Args {
+    Args(std::vector<int> cols, int k, long iterations = 100,
+         double tolerance = 1e-9, unsigned seed = 0)
+        : cols(cols), k(k), iterations(iterations), tolerance(tolerance),
+          seed(seed) {}
+    const std::vector<int> cols;  ///< Feature columns.
+    const int k;                  ///< Number of clusters.
+    const long iterations;        ///< Maximum number of iterations.
+    const double tolerance;       ///< Converged when no centroid moves more
+                                  ///< than this (squared distance).
+    const unsigned seed;          ///< Seed of the k-means++ sampling.
+  };
+
+  struct Model {
+    Model(int k, int dims) : k(k), dims(dims), centroids(k * dims, 0),
+                             iterations(0), inertia(0) {}
+
+    /// Index of the centroid nearest to a row of the training matrix.
+    int predict(const RowView& row, const std::vector<int>& cols) const {
+      std::vector<double> point(dims);
+      gatherFeatures(row.getData(), cols, point.data());
+      double distance;
+      return nearest(point.data(), distance);
+    }
+
+    /// Index of the centroid nearest to a point, and its squared distance.
+    int nearest(const double* point, double& distance) const {
+      int best = 0;
+      distance = std::numeric_limits<double>::infinity();
+      for (int c=0; c<k; c++) {
+        const double* centroid = centroids.data() + c * dims;
+        double d = 0;
+        for (int j=0; j<dims; j++) {
+          double delta = point[j] - centroid[j];
+          d += delta * delta;
+        }
+        if (d < distance) {
+          distance = d;
+          best = c;
+        }
+      }
+      return best;
+    }
+
+    int k;
+    int dims;
+    std::vector<double> centroids;  ///< k rows of dims values.
+    long iterations;                ///< Iterations run.
+    double inertia;                 ///< Sum of squared distances to
+                                    ///< the nearest centroid.
+  };
+
+  struct Partial {
+    Partial(int k, int dims) : sums(k * dims), counts(k), point(dims) {}
+    std::vector<double> sums;    ///< Per-cluster feature sums.
+    std::vector<long> counts;    ///< Per-cluster point counts.
+    std::vector<double> point;   ///< Scratch feature vector.
+    double inertia;
+  };
+
+  /**
+   * k-means++ initialization: each next centroid is a row sampled
+   * with probability proportional to its squared distance from the
+   * nearest centroid chosen so far. Distances are kept per block and
+   * updated in parallel with only the newest centroid each round.
+   */
+  Model init(DMatrix& matrix, const Args& args,
+             std::shared_ptr<QueryContext> context) {
+    int dims = args.cols.size();
+    if (args.k < 1 || args.k > matrix.getRows()) {
+      throw std::invalid_argument("k must be between 1 and the row count");
+    }
+
+    Model model(args.k, dims);
+    std::mt19937_64 gen(args.seed);
+    std::uniform_real_distribution<> uniform(0, 1);
+
+    auto const &blocks = matrix.getMemoryBlocks();
+    std::vector<std::vector<double>> distances(blocks.size());
+    std::vector<double> blockTotals(blocks.size());
+
+    long first = std::min<long>(uniform(gen) * matrix.getRows(),
+                                matrix.getRows() - 1);
+    gatherFeatures(matrix.row(first).getData(), args.cols,
+                   model.centroids.data());
+
+    for (int c=1; c<args.k; c++) {
+      const double* newest = model.centroids.data() + (c - 1) * dims;
+      pool.parallelFor(context, blocks.size(), [&](size_t b) {
+          auto const &blockData = blocks[b]->getBlockData();
+          auto &blockDistances = distances[b];
+          if (blockDistances.empty()) {
+            blockDistances.assign(blockData.getRows(),
+                                  std::numeric_limits<double>::infinity());
+          }
+
+          std::vector<double> point(dims);
+          double total = 0;
+          for (long i=0; i<blockData.getRows(); i++) {
+            gatherFeatures(blockData.getData() + i * blockData.getCols(),
+                           args.cols, point.data());
+            double d = 0;
+            for (int j=0; j<dims; j++) {
+              double delta = point[j] - newest[j];
+              d += delta * delta;
+            }
+            blockDistances[i] = std::min(blockDistances[i], d);
+            total += blockDistances[i];
+          }
+          blockTotals[b] = total;
+        });
+
+      long row = sample(matrix, distances, blockTotals, uniform(gen));
+      if (row < 0) {
+        row = std::min<long>(uniform(gen) * matrix.getRows(),
+                             matrix.getRows() - 1);
+      }
+      gatherFeatures(matrix.row(row).getData(), args.cols,
+                     model.centroids.data() + c * dims);
+    }
+
+    return model;
+  }
+
+  Partial makePartial(const DMatrix&, size_t, const Args&,
+                      const Model& model) {
+    return Partial(model.k, model.dims);
+  }
+
+  void reset(Partial& partial) {
+    std::fill(partial.sums.begin(), partial.sums.end(), 0.0);
+    std::fill(partial.counts.begin(), partial.counts.end(), 0);
+    partial.inertia = 0;
+  }
+
+  void accumulate(const MemoryBlock& block, const Args& args,
+                  const Model& model, long, Partial& partial) {
+    auto const &blockData = block.getBlockData();
+    double* point = partial.point.data();
+    for (long i=0; i<blockData.getRows(); i++) {
+      gatherFeatures(blockData.getData() + i * blockData.getCols(),
+                     args.cols, point);
+      double distance;
+      int c = model.nearest(point, distance);
+      addInto(partial.sums.data() + c * model.dims, point, model.dims);
+      partial.counts[c]++;
+      partial.inertia += distance;
+    }
+  }
+
+  void merge(Partial& into, const Partial& from) {
+    addInto(into.sums.data(), from.sums.data(), into.sums.size());
+    addInto(into.counts.data(), from.counts.data(), into.counts.size());
+    into.inertia += from.inertia;
+  }
+
+  bool update(Model& model, const Partial& total, const Args& args,
+              long iteration) {
+    double shift = 0;
+    for (int c=0; c<model.k; c++) {
+      if (total.counts[c] == 0) {
+        continue;  // Empty clusters keep their centroid.
+      }
+
+      double* centroid = model.centroids.data() + c * model.dims;
+      const double* sum = total.sums.data() + c * model.dims;
+      double moved = 0;
+      for (int j=0; j<model.dims; j++) {
+        double next = sum[j] / total.counts[c];
+        moved += (next - centroid[j]) * (next - centroid[j]);
+        centroid[j] = next;
+      }
+      shift = std::max(shift, moved);
+    }
+
+    model.inertia = total.inertia;
+    model.iterations = iteration + 1;
+    return shift <= args.tolerance;
+  }
+
+ private:
+  /**
+   * Global row whose distance interval contains u * total, or -1 if
+   * all distances are zero.
+   */
+  static long sample(const DMatrix& matrix,
+                     const std::vector<std::vector<double>>& distances,
+                     const std::vector<double>& blockTotals, double u) {
+    double total = 0;
+    for (double blockTotal : blockTotals) {
+      total += blockTotal;
+    }
+    if (!(total > 0)) {
+      return -1;
+    }
+
+    double target = u * total;
+    for (size_t b=0; b<distances.size(); b++) {
+      if (target >= blockTotals[b] && b + 1 < distances.size()) {
+        target -= blockTotals[b];
+        continue;
+      }
+
+      for (size_t i=0; i<distances[b].size(); i++) {
+        target -= distances[b][i];
+        if (target < 0 && distances[b][i] > 0) {
+          return matrix.getStartRow(b) + i;
+        }
+      }
+      return -1;
+    }
+    return -1;
+  }
+};
+
+/**
+ * Logistic regression trained with mini-batch stochastic gradient
+ * descent. Each iteration every block contributes rows drawn uniformly
+ * at random (with replacement), as many as its share of the matrix,
+ * so a batch spans all blocks and is unbiased by row order.
+ */
+class LogisticRegression {
+ public:
+  struct Args {
+    Args(std::vector<int> cols, int labelCol, long iterations = 100,
+         long batchSize = 1024, double learningRate = 0.1, double l2 = 0,
+         unsigned seed = 0)
+        : cols(cols), labelCol(labelCol), iterations(iterations),
+          batchSize(batchSize), learningRate(learningRate), l2(l2),
+          seed(seed) {}
+    const std::vector<int> cols;  ///< Feature columns.
+    const int labelCol;           ///< Column of 0/1 labels.
+    const long iterations;        ///< Number of mini-batch steps.
+    const long batchSize;         ///< Rows per mini-batch.
+    const double learningRate;
+    const double l2;              ///< L2 penalty (not applied to the bias).
+    const unsigned seed;          ///< Seed of the batch sampling.
+  };
+
+  struct Model {
+    Model(int dims) : weights(dims + 1, 0), loss(0), iterations(0) {}
+
+    /// Probability that a row of the training matrix has label 1.
+    double predict(const RowView& row, const std::vector<int>& cols) const {
+      double z = weights.back();
+      for (size_t j=0; j<cols.size(); j++) {
+        z += weights[j] * row[cols[j]];
+      }
+      return 1 / (1 + std::exp(-z));
+    }
+
+    std::vector<double> weights;  ///< Feature weights followed by the bias.
+    double loss;                  ///< Mean log loss of the last batch.
+    long iterations;              ///< Iterations run.
+  };
+
+  struct Partial {
+    Partial(int dims, long batchRows, unsigned seed)
+        : gradient(dims + 1), point(dims), batchRows(batchRows), gen(seed) {}
+    std::vector<double> gradient;  ///< Gradient sum, bias last.
+    std::vector<double> point;     ///< Scratch feature vector.
+    long batchRows;                ///< Rows this block adds to a batch.
+    std::mt19937_64 gen;           ///< Source of batch rows.
+    double loss;
+    long count;
+  };
+
+  Model init(DMatrix& matrix, const Args& args,
+             std::shared_ptr<QueryContext>) {
+    if (matrix.getRows() == 0 || args.batchSize < 1) {
+      throw std::invalid_argument("need rows and a positive batch size");
+    }
+    return Model(args.cols.size());
+  }
+
+  Partial makePartial(const DMatrix& matrix, size_t block, const Args& args,
+                      const Model&) {
+    long rows = matrix.getMemoryBlocks()[block]->getBlockData().getRows();
+    long batchRows = (args.batchSize * rows + matrix.getRows() - 1) /
+                     matrix.getRows();
+    return Partial(args.cols.size(), std::min(batchRows, rows),
+                   args.seed * 7919 + block);
+  }
+
+  void reset(Partial& partial) {
+    std::fill(partial.gradient.begin(), partial.gradient.end(), 0.0);
+    partial.loss = 0;
+    partial.count = 0;
+  }
+
+  void accumulate(const MemoryBlock& block, const Args& args,
+                  const Model& model, long, Partial& partial) {
+    auto const &blockData = block.getBlockData();
+    long rows = blockData.getRows();
+    if (rows == 0 || partial.batchRows == 0) {
+      return;
+    }
+
+    int dims = args.cols.size();
+    const double* weights = model.weights.data();
+    double* point = partial.point.data();
+    double* gradient = partial.gradient.data();
+    std::uniform_int_distribution<long> pick(0, rows - 1);
+    for (long n=0; n<partial.batchRows; n++) {
+      const double* row = blockData.getData() +
+                          pick(partial.gen) * blockData.getCols();
+      gatherFeatures(row, args.cols, point);
+
+      double z = weights[dims];
+      for (int j=0; j<dims; j++) {
+        z += weights[j] * point[j];
+      }
+      double p = 1 / (1 + std::exp(-z));
+      double y = row[args.labelCol];
+      double error = p - y;
+
+      for (int j=0; j<dims; j++) {
+        gradient[j] += error * point[j];
+      }
+      gradient[dims] += error;
+
+      const double eps = 1e-12;
+      partial.loss -= y * std::log(p + eps) + (1 - y) * std::log(1 - p + eps);
+      partial.count++;
+    }
+  }
+
+  void merge(Partial& into, const Partial& from) {
+    addInto(into.gradient.data(), from.gradient.data(), into.gradient.size());
+    into.loss += from.loss;
+    into.count += from.count;
+  }
+
+  bool update(Model& model, const Partial& total, const Args& args,
+              long iteration) {
+    if (total.count == 0) {
+      return true;
+    }
+
+    size_t dims = model.weights.size() - 1;
+    for (size_t j=0; j<=dims; j++) {
+      double penalty = j < dims ? args.l2 * model.weights[j] : 0;
+      model.weights[j] -= args.learningRate *
+                          (total.gradient[j] / total.count + penalty);
+    }
+
+    model.loss = total.loss / total.count;
+    model.iterations = iteration + 1;
+    return false;
+  }
+};
+
+
+IterativeOperation<KMeans> KMEANS;
+IterativeOperation<LogisticRegression> LOGISTIC_SGD;
+
+}
+
+#endif
@@ -2,12 +2,20 @@
 #define OPS_H
 
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <future>
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <random>
 #include <set>
+#include <stdexcept>
 #include <thread>
+#include <type_traits>
 #include <vector>
+#include "cache.h"
 #include "matrix.h"
 #include "thread_pool.h"
 
@@ -15,6 +23,27 @@ namespace Multitude {
 
 static ThreadPool pool(std::thread::hardware_concurrency());
 
+/**
+ * Element-wise a += b over n values; a plain loop the compiler
+ * vectorizes. Used to merge per-block partial results.
+ */
+template<typename V>
+inline void addInto(V* a, const V* b, size_t n) {
+  for (size_t i=0; i<n; i++) {
+    a[i] += b[i];
+  }
+}
+
+/// Whether value operation T defines the optional prepare step.
+template<typename T, typename = void>
+struct HasPrepare : std::false_type {};
+
+template<typename> struct VoidOf { typedef void type; };
+
+template<typename T>
+struct HasPrepare<T, typename VoidOf<typename T::Summary>::type>
+    : std::true_type {};
+
 /**
  * Operation on a distributed matrix that produces a value by combining
  * results of applying an operation to individual blocks.
@@ -25,10 +54,40 @@ static ThreadPool pool(std::thread::hardware_concurrency());
  *   3. Define a nested type Result: final result of the operation.
  *   4. Define function apply(block, args): apply operation to one block.
  *   5. Define function combine(results): combine individual block results.
+ *
+ * To support caching (setCache), T must also define function
+ * hashArgs(args) and Args must define operator==; cached results are
+ * matched by comparing args, the hash only buckets them. Only
+ * deterministic operations should define these.
+ *
+ * T may also derive its args from the matrix before blocks are
+ * applied (e.g. resolve a range from block statistics) by defining:
+ *   - a nested type Summary: what prepare needs from one block;
+ *   - function needsPrepare(args);
+ *   - function summarize(block, args): summary of one block;
+ *   - function prepare(args, summaries): args to apply blocks with.
+ * Blocks are summarized by pool tasks too, so every entry point
+ * (including StandingOperation) prepares args without blocking.
  */
 template<typename T>
 class ValueOperation {
  public:
+  /**
+   * Cache per-block results of this operation. Blocks whose result
+   * for the same args is cached are not scheduled; their results are
+   * combined with the freshly computed ones. Pass null to disable.
+   * Must not be called while the operation is being applied.
+   *
+   * @param cache - Cache to use, possibly shared with other operations.
+   */
+  void setCache(std::shared_ptr<ResultCache> cache) {
+    this->cache = cache;
+    makeTag = [this](const typename T::Args& args) {
+      return std::make_shared<const ArgsTag<T, typename T::Args>>(
+          args, t.hashArgs(args));
+    };
+  }
+
   /**
    * Apply the templated operation to matrix subject to operation args.
    *
@@ -37,31 +96,272 @@ class ValueOperation {
    * @return - Operation result.
    */
   typename T::Result apply(DMatrix& matrix, typename T::Args args) {
-    std::vector<std::future<typename T::BlockResult>> resultFutures;
-    for (auto const &entry : matrix.getMemoryBlocks()) {
-      auto const &block = entry.second;
-      std::function<typename T::BlockResult ()> producer = [&]() {
-        return t.apply(*block, args);
+    return applyAsync(matrix, args).get();
+  }
+
+  /**
+   * Apply the templated operation to matrix without blocking the
+   * caller. Block tasks are scheduled on the pool under the query's
+   * context (after the summary tasks of a prepare step, if any), and
+   * the last block to finish runs combine and fulfills the returned
+   * future.
+   *
+   * @param matrix - Matrix to apply operation t.
+   * @param args - Operation arguments.
+   * @param context - Query priority and cancellation handle.
+   * @return - Future of the operation result; holds QueryCancelled
+   *           if the query is cancelled before all blocks ran.
+   */
+  std::future<typename T::Result> applyAsync(
+      DMatrix& matrix, typename T::Args args,
+      std::shared_ptr<QueryContext> context =
+          std::make_shared<QueryContext>()) {
+    auto blocks = std::make_shared<const Blocks>(matrix.getMemoryBlocks());
+    auto pending = std::make_shared<PendingResult>(blocks->size());
+    auto future = pending->promise.get_future();
+
+    try {
+      prepare(blocks, args, context, pending, HasPrepare<T>());
+    } catch (...) {
+      pending->fail(std::current_exception());
+      complete(*pending);
+    }
+    return future;
+  }
+
+ private:
+  typedef std::vector<std::shared_ptr<MemoryBlock>> Blocks;
+
+  /**
+   * Block results of an in-flight applyAsync, filled in by block
+   * tasks in any order.
+   */
+  struct PendingResult {
+    PendingResult(size_t numBlocks)
+        : results(numBlocks), remaining(numBlocks), failed(false) {}
+
+    /// Record the first failure of any block task.
+    void fail(std::exception_ptr e) {
+      bool expected = false;
+      if (failed.compare_exchange_strong(expected, true)) {
+        error = e;
+      }
+    }
+
+    std::vector<std::shared_ptr<const typename T::BlockResult>> results;
+    std::atomic<size_t> remaining;
+    std::atomic<bool> failed;
+    std::exception_ptr error;
+    std::promise<typename T::Result> promise;
+  };
+
+  /**
+   * Summaries of an in-flight prepare step, filled in by summary tasks
+   * in any order.
+   */
+  template<typename Summary>
+  struct PendingSummaries {
+    PendingSummaries(size_t numBlocks)
+        : summaries(numBlocks), remaining(numBlocks) {}
+    std::vector<std::shared_ptr<const Summary>> summaries;
+    std::atomic<size_t> remaining;
+  };
+
+  /// Operations without a prepare step apply their args as given.
+  void prepare(std::shared_ptr<const Blocks> blocks, typename T::Args args,
+               std::shared_ptr<QueryContext> context,
+               std::shared_ptr<PendingResult> pending, std::false_type) {
+    schedule(blocks, args, context, pending);
+  }
+
+  /**
+   * Summarize every block in a pool task; the last summary task
+   * prepares the args and schedules the block tasks.
+   */
+  void prepare(std::shared_ptr<const Blocks> blocks, typename T::Args args,
+               std::shared_ptr<QueryContext> context,
+               std::shared_ptr<PendingResult> pending, std::true_type) {
+    if (blocks->empty() || !t.needsPrepare(args)) {
+      schedule(blocks, args, context, pending);
+      return;
+    }
+
+    typedef typename T::Summary Summary;
+    auto summaries =
+        std::make_shared<PendingSummaries<Summary>>(blocks->size());
+    for (size_t idx=0; idx<blocks->size(); idx++) {
+      std::function<void ()> task = [this, blocks, args, context, pending,
+                                     summaries, idx]() {
+        try {
+          if (context->isCancelled()) {
+            throw QueryCancelled();
+          }
+          summaries->summaries[idx] = std::make_shared<const Summary>(
+              t.summarize(*(*blocks)[idx], args));
+        } catch (...) {
+          pending->fail(std::current_exception());
+        }
+
+        if (--summaries->remaining > 0) {
+          return;
+        }
+
+        try {
+          if (!pending->failed) {
+            std::vector<Summary> ordered;
+            ordered.reserve(blocks->size());
+            for (auto const &summary : summaries->summaries) {
+              ordered.push_back(*summary);
+            }
+            schedule(blocks, t.prepare(args, ordered), context, pending);
+            return;
+          }
+        } catch (...) {
+          pending->fail(std::current_exception());
+        }
+        complete(*pending);
+      };
+
+      pool.submit(context, task);
+    }
+  }
+
+  /**
+   * Look up cached block results and schedule a task for every other
+   * block.
+   */
+  void schedule(std::shared_ptr<const Blocks> blocks, typename T::Args args,
+                std::shared_ptr<QueryContext> context,
+                std::shared_ptr<PendingResult> pending) {
+    std::vector<size_t> missing;
+    std::shared_ptr<const CacheTag> tag = cache ? makeTag(args) : nullptr;
+    for (size_t i=0; i<blocks->size(); i++) {
+      if (cache) {
+        CacheKey key((*blocks)[i]->getId(), tag);
+        pending->results[i] =
+            std::static_pointer_cast<const typename T::BlockResult>(
+                cache->lookup(key));
+      }
+      if (!pending->results[i]) {
+        missing.push_back(i);
+      }
+    }
+
+    pending->remaining = missing.size();
+    if (missing.empty()) {
+      complete(*pending);
+      return;
+    }
+
+    auto cache = this->cache;
+    for (size_t idx : missing) {
+      auto block = (*blocks)[idx];
+      std::function<void ()> task = [this, pending, block, args, context,
+                                     cache, tag, idx]() {
+        try {
+          if (context->isCancelled()) {
+            throw QueryCancelled();
+          }
+          auto result = std::make_shared<const typename T::BlockResult>(
+              t.apply(*block, args));
+          if (cache) {
+            CacheKey key(block->getId(), tag);
+            cache->insert(key, result);
+          }
+          pending->results[idx] = result;
+        } catch (...) {
+          pending->fail(std::current_exception());
+        }
+
+        if (--pending->remaining == 0) {
+          complete(*pending);
+        }
       };
 
-      resultFutures.push_back(pool.schedule(producer));
+      pool.submit(context, task);
     }
+  }
 
-    std::vector<typename T::BlockResult> results;
-    for (auto &resultFuture : resultFutures) {
-      results.push_back(resultFuture.get());
+  /**
+   * Combine block results in block order and fulfill the promise.
+   */
+  void complete(PendingResult& pending) {
+    if (pending.failed) {
+      pending.promise.set_exception(pending.error);
+      return;
     }
 
-    return t.combine(results);
+    try {
+      std::vector<typename T::BlockResult> results;
+      results.reserve(pending.results.size());
+      for (auto &result : pending.results) {
+        results.push_back(*result);
+      }
+      pending.promise.set_value(t.combine(results));
+    } catch (...) {
+      pending.promise.set_exception(std::current_exception());
+    }
   }
 
- private:
   T t;
+  std::shared_ptr<ResultCache> cache;
+  std::function<std::shared_ptr<const CacheTag> (const typename T::Args&)>
+      makeTag;
+};
+
+/**
+ * Value operation with fixed args whose per-block results are kept in
+ * a ResultCache between applications. Blocks are immutable and keep
+ * their ids, so after DContext::refresh appends rows, re-applying only
+ * computes the new blocks before combining; results of blocks no
+ * longer in the matrix age out of the cache.
+ */
+template<typename T>
+class StandingOperation {
+ public:
+  /**
+   * @param args - Operation arguments.
+   * @param cache - Cache of block results, possibly shared with other
+   *                operations; should hold at least one result per
+   *                block of the matrix. Defaults to a private cache.
+   */
+  StandingOperation(typename T::Args args,
+                    std::shared_ptr<ResultCache> cache =
+                        std::make_shared<ResultCache>(1 << 16))
+      : args(args), cache(cache) {
+    op.setCache(cache);
+  }
+
+  /**
+   * Apply the operation, computing only blocks not seen before.
+   *
+   * @param matrix - Matrix to apply operation t.
+   * @param context - Query priority and cancellation handle.
+   * @return - Operation result.
+   */
+  typename T::Result apply(DMatrix& matrix,
+                           std::shared_ptr<QueryContext> context =
+                               std::make_shared<QueryContext>()) {
+    return op.applyAsync(matrix, args, context).get();
+  }
+
+  /// Hit/miss counters of the result cache.
+  CacheStats getStats() { return cache->getStats(); }
+
+ private:
+  StandingOperation(StandingOperation const&) = delete;
+  void operator=(StandingOperation const&) = delete;
+
+  ValueOperation<T> op;
+  const typename T::Args args;
+  std::shared_ptr<ResultCache> cache;
 };
 
 class Count {
  public:
-  struct Args {};
+  struct Args {
+    bool operator==(const Args&) const { return true; }
+  };
 
   struct Result {
     Result(long count) : count(count) {}
@@ -73,11 +373,13 @@ class Count {
     const long count;
   };
 
-  BlockResult apply(const MemoryBlock& block, const Args& args) {
+  BlockResult apply(const MemoryBlock& block, const Args&) {
     auto const &data = block.getBlockData();
     return {data.getRows()};
   }
 
+  size_t hashArgs(const Args&) { return 0; }
+
   Result combine(std::vector<BlockResult> results) {
     long count = 0;
     for (auto const &result : results) {
@@ -91,6 +393,7 @@ class SumColumn {
  public:
   struct Args {
     Args(int col) : col(col) {}
+    bool operator==(const Args& other) const { return col == other.col; }
     const int col;
   };
 
@@ -118,6 +421,8 @@ class SumColumn {
     return {sum};
   }
 
+  size_t hashArgs(const Args& args) { return args.col; }
+
   Result combine(std::vector<BlockResult> results) {
     double sum = 0;
     for (auto const &result : results) {
@@ -132,6 +437,7 @@ class MaxColumn {
  public:
   struct Args {
     Args(int col) : col(col) {}
+    bool operator==(const Args& other) const { return col == other.col; }
     const int col;
   };
 
@@ -157,9 +463,11 @@ class MaxColumn {
     return {max};
   }
 
+  size_t hashArgs(const Args& args) { return args.col; }
+
   Result combine(std::vector<BlockResult> results) {
     double max = results[0].max;
-    for (int i=1; i<results.size(); i++) {
+    for (size_t i=1; i<results.size(); i++) {
       max = std::max(max, results[i].max);
     }
 
@@ -171,6 +479,7 @@ class MinColumn {
  public:
   struct Args {
     Args(int col) : col(col) {}
+    bool operator==(const Args& other) const { return col == other.col; }
     const int col;
   };
 
@@ -184,7 +493,7 @@ class MinColumn {
     const double min;
   };
 
-  BlockResult apply(const MemoryBlock& block, Args& args) {
+  BlockResult apply(const MemoryBlock& block, const Args& args) {
     auto const &blockData = block.getBlockData();
     auto const data = blockData.getData();
     double min = data[0];
@@ -196,9 +505,11 @@ class MinColumn {
     return {min};
   }
 
+  size_t hashArgs(const Args& args) { return args.col; }
+
   Result combine(std::vector<BlockResult> results) {
     double min = results[0].min;
-    for (int i=1; i<results.size(); i++) {
+    for (size_t i=1; i<results.size(); i++) {
       min = std::min(min, results[i].min);
     }
 
@@ -264,12 +575,263 @@ class RandomSample {
   }
 };
 
+/**
+ * Bin spacing of a Histogram.
+ */
+enum class BinScale {
+  LINEAR,  ///< Equal-width bins over [min, max].
+  LOG      ///< Equal-width bins over [log(min), log(max)]; min > 0.
+};
+
+/**
+ * Histogram of a column over a fixed number of bins, optionally with
+ * the per-bin sum (and mean) of a second column. Values below or above
+ * the range are counted as underflow/overflow, NaNs as missing; the
+ * range includes max.
+ */
+class Histogram {
+ public:
+  struct Args {
+    Args(int col, int bins, double min, double max,
+         BinScale scale = BinScale::LINEAR, int valueCol = -1)
+        : col(col), bins(bins), min(min), max(max), scale(scale),
+          valueCol(valueCol) {}
+
+    /// Args taking the range from the column's block statistics.
+    static Args autoRange(int col, int bins,
+                          BinScale scale = BinScale::LINEAR,
+                          int valueCol = -1) {
+      double nan = std::numeric_limits<double>::quiet_NaN();
+      return {col, bins, nan, nan, scale, valueCol};
+    }
+
+    /// Whether the range still has to be resolved from the matrix.
+    bool isAutoRange() const { return std::isnan(min) || std::isnan(max); }
+
+    bool operator==(const Args& other) const {
+      return col == other.col && bins == other.bins && min == other.min &&
+          max == other.max && scale == other.scale &&
+          valueCol == other.valueCol;
+    }
+
+    const int col;
+    const int bins;
+    const double min;
+    const double max;
+    const BinScale scale;
+    const int valueCol;  ///< Column averaged per bin, or -1.
+  };
+
+  struct BlockResult {
+    BlockResult(std::shared_ptr<std::vector<double>> edges,
+                std::shared_ptr<std::vector<long>> counts,
+                std::shared_ptr<std::vector<double>> sums)
+        : edges(edges), counts(counts), sums(sums) {}
+    /// Bin edges the block was counted with.
+    const std::shared_ptr<std::vector<double>> edges;
+    /// Counts per slot: underflow, bins..., overflow, missing.
+    const std::shared_ptr<std::vector<long>> counts;
+    /// Value column sums per slot (empty without a value column).
+    const std::shared_ptr<std::vector<double>> sums;
+  };
+
+  struct Result {
+    Result(std::shared_ptr<std::vector<double>> edges,
+           std::shared_ptr<std::vector<long>> counts,
+           std::shared_ptr<std::vector<double>> sums,
+           long underflow, long overflow, long missing)
+        : edges(edges), counts(counts), sums(sums), underflow(underflow),
+          overflow(overflow), missing(missing) {}
+
+    /// Mean of the value column per bin (NaN for empty bins).
+    std::vector<double> means() const {
+      std::vector<double> means(counts->size(),
+                                std::numeric_limits<double>::quiet_NaN());
+      for (size_t i=0; i<sums->size(); i++) {
+        if ((*counts)[i] > 0) {
+          means[i] = (*sums)[i] / (*counts)[i];
+        }
+      }
+      return means;
+    }
+
+    const std::shared_ptr<std::vector<double>> edges;  ///< bins+1 edges.
+    const std::shared_ptr<std::vector<long>> counts;   ///< Count per bin.
+    const std::shared_ptr<std::vector<double>> sums;   ///< Value sum per bin.
+    const long underflow;
+    const long overflow;
+    const long missing;
+  };
+
+  /// Min/max of the column in one block, for auto-range args.
+  typedef ColumnStats Summary;
+
+  bool needsPrepare(const Args& args) { return args.isAutoRange(); }
+
+  /// Block statistics are memoized, so repeated queries are cheap.
+  Summary summarize(const MemoryBlock& block, const Args& args) {
+    return block.getColumnStats(args.col);
+  }
+
+  /**
+   * Fill in the range of auto-range args from the block statistics of
+   * the column. Log ranges start at the smallest positive value;
+   * non-positive values are counted as underflow.
+   */
+  Args prepare(const Args& args, const std::vector<Summary>& summaries) {
+    bool log = args.scale == BinScale::LOG;
+    double min = std::numeric_limits<double>::infinity();
+    double max = -min;
+    for (auto const &stats : summaries) {
+      min = std::min(min, log ? stats.minPositive : stats.min);
+      max = std::max(max, stats.max);
+    }
+
+    if (min > max) {
+      // No values (or, for log, no positive values).
+      min = log ? 1 : 0;
+      max = min;
+    }
+    if (min == max) {
+      max = log ? min * 2 : min + 1;
+    }
+
+    return {args.col, args.bins, min, max, args.scale, args.valueCol};
+  }
+
+  BlockResult apply(const MemoryBlock& block, const Args& args) {
+    validate(args);
+    int bins = args.bins;
+    int slots = bins + 3;
+    double lo = transform(args.min, args.scale);
+    double hi = transform(args.max, args.scale);
+    double width = bins / (hi - lo);
+
+    auto const &blockData = block.getBlockData();
+    auto const data = blockData.getData();
+    long rows = blockData.getRows();
+    long cols = blockData.getCols();
+
+    // Bin indexes are computed a chunk at a time in a branch-free loop
+    // the compiler can vectorize; counting then alternates between
+    // interleaved count arrays so runs of equal bins do not serialize
+    // on one counter.
+    const int chunk = 512;
+    const int lanes = 4;
+    int slot[chunk];
+    std::vector<long> counts(lanes * slots, 0);
+    auto sums = std::make_shared<std::vector<double>>(
+        args.valueCol >= 0 ? slots : 0, 0.0);
+
+    for (long begin=0; begin<rows; begin+=chunk) {
+      int n = std::min<long>(chunk, rows - begin);
+      const double* row = data + begin * cols;
+      for (int j=0; j<n; j++) {
+        double x = transform(row[j * cols + args.col], args.scale);
+        double b = (x - lo) * width;
+        int k = b < 0 ? 0 : (x <= hi ? 1 + std::min((int)b, bins - 1)
+                                    : bins + 1);
+        slot[j] = std::isnan(x) ? bins + 2 : k;
+      }
+
+      for (int j=0; j<n; j++) {
+        counts[(j % lanes) * slots + slot[j]]++;
+      }
+
+      if (args.valueCol >= 0) {
+        for (int j=0; j<n; j++) {
+          (*sums)[slot[j]] += row[j * cols + args.valueCol];
+        }
+      }
+    }
+
+    auto total = std::make_shared<std::vector<long>>(slots, 0);
+    for (int lane=0; lane<lanes; lane++) {
+      addInto(total->data(), counts.data() + lane * slots, slots);
+    }
+
+    return {binEdges(args), total, sums};
+  }
+
+  Result combine(std::vector<BlockResult> results) {
+    if (results.empty()) {
+      throw std::invalid_argument("histogram of an empty matrix");
+    }
+
+    size_t slots = results[0].counts->size();
+    std::vector<long> counts(slots, 0);
+    std::vector<double> sums(results[0].sums->size(), 0.0);
+    for (auto const &result : results) {
+      addInto(counts.data(), result.counts->data(), slots);
+      addInto(sums.data(), result.sums->data(), sums.size());
+    }
+
+    int bins = slots - 3;
+    auto binCounts = std::make_shared<std::vector<long>>(
+        counts.begin() + 1, counts.begin() + 1 + bins);
+    auto binSums = std::make_shared<std::vector<double>>();
+    if (!sums.empty()) {
+      binSums->assign(sums.begin() + 1, sums.begin() + 1 + bins);
+    }
+
+    return {results[0].edges, binCounts, binSums, counts[0], counts[bins + 1],
+            counts[bins + 2]};
+  }
+
+  size_t hashArgs(const Args& args) {
+    size_t h = std::hash<int>()(args.col);
+    h = hashCombine(h, std::hash<int>()(args.bins));
+    h = hashCombine(h, std::hash<double>()(args.min));
+    h = hashCombine(h, std::hash<double>()(args.max));
+    h = hashCombine(h, std::hash<int>()((int)args.scale));
+    return hashCombine(h, std::hash<int>()(args.valueCol));
+  }
+
+  /**
+   * Bin edges for args with an explicit range.
+   */
+  static std::shared_ptr<std::vector<double>> binEdges(const Args& args) {
+    double lo = transform(args.min, args.scale);
+    double hi = transform(args.max, args.scale);
+    auto edges = std::make_shared<std::vector<double>>();
+    for (int i=0; i<=args.bins; i++) {
+      double x = lo + (hi - lo) * i / args.bins;
+      edges->push_back(args.scale == BinScale::LOG ? std::exp(x) : x);
+    }
+    return edges;
+  }
+
+ private:
+  static void validate(const Args& args) {
+    if (args.bins < 1) {
+      throw std::invalid_argument("histogram needs at least one bin");
+    } else if (args.isAutoRange()) {
+      throw std::invalid_argument("histogram range not resolved");
+    } else if (!(args.max > args.min)) {
+      throw std::invalid_argument("histogram range is empty");
+    } else if (args.scale == BinScale::LOG && args.min <= 0) {
+      throw std::invalid_argument("log histogram needs a positive range");
+    }
+  }
+
+  /// Position of a value on the bin axis; non-positive values map
+  /// below any log range.
+  static double transform(double value, BinScale scale) {
+    if (scale == BinScale::LINEAR) {
+      return value;
+    }
+    return value > 0 ? std::log(value)
+                     : (std::isnan(value)
+                        ? value : -std::numeric_limits<double>::infinity());
+  }
+};
 
 ValueOperation<Count> COUNT;
 ValueOperation<SumColumn> SUM;
 ValueOperation<MaxColumn> MAX;
 ValueOperation<MinColumn> MIN;
 ValueOperation<RandomSample> SAMPLE;
+ValueOperation<Histogram> HISTOGRAM;
 
 }
 
@@ -0,0 +1,353 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include "allocator.h"
+#include "matrix.h"
+#include "ops.h"
+#include "thread_pool.h"
+
+namespace Multitude {
+
+/**
+ * Wrap a computed single-column buffer as a memory block.
+ */
+inline std::shared_ptr<MemoryBlock> columnBlock(long rows, BlockBuffer data) {
+  auto blockData = std::make_unique<BlockData>(rows, 1, std::move(data));
+  return std::make_shared<MemoryBlock>(nextBlockId(), std::move(blockData));
+}
+
+/**
+ * Cumulative operation on a column of a distributed matrix, producing
+ * a new single-column matrix in row order. Output blocks line up row
+ * for row with the input blocks.
+ *
+ * Runs as a two-phase parallel prefix scan: every block is reduced to
+ * a carry in parallel, the carries are scanned in block order, and
+ * every block is then scanned in parallel starting from the carry of
+ * the blocks before it.
+ *
+ * The templated type, T, must have the following traits:
+ *   1. Define a nested type named Args: arguments passed to apply.
+ *   2. Define a nested type Carry: state carried across block boundaries.
+ *   3. Define function identity(): carry of an empty prefix.
+ *   4. Define function reduce(block, args): carry of a whole block.
+ *   5. Define function combine(a, b): carry of a followed by b.
+ *   6. Define function scan(block, args, carry, out): write one output
+ *      value per block row given the carry of all preceding rows.
+ */
+template<typename T>
+class ScanOperation {
+ public:
+  /**
+   * Apply the templated scan to matrix subject to operation args.
+   *
+   * @param matrix - Matrix to scan.
+   * @param args - Operation arguments.
+   * @param context - Query priority and cancellation handle.
+   * @return - Single-column matrix of scan results.
+   */
+  std::unique_ptr<DMatrix> apply(DMatrix& matrix, typename T::Args args,
+                                 std::shared_ptr<QueryContext> context =
+                                     std::make_shared<QueryContext>()) {
+    auto const &blocks = matrix.getMemoryBlocks();
+    std::vector<typename T::Carry> carries(blocks.size(), t.identity());
+    pool.parallelFor(context, blocks.size(), [&](size_t i) {
+        carries[i] = t.reduce(*blocks[i], args);
+      });
+
+    typename T::Carry prefix = t.identity();
+    for (auto &carry : carries) {
+      typename T::Carry blockCarry = carry;
+      carry = prefix;
+      prefix = t.combine(prefix, blockCarry);
+    }
+
+    std::vector<std::shared_ptr<MemoryBlock>> outBlocks(blocks.size());
+    pool.parallelFor(context, blocks.size(), [&](size_t i) {
+        long rows = blocks[i]->getBlockData().getRows();
+        BlockBuffer out = BlockAllocator::instance().allocate(rows);
+        t.scan(*blocks[i], args, carries[i], out.get());
+        outBlocks[i] = columnBlock(rows, std::move(out));
+      });
+
+    std::vector<std::shared_ptr<RemoteBlock>> empty;
+    return std::make_unique<DMatrix>(outBlocks, empty, 1);
+  }
+
+ private:
+  T t;
+};
+
+/**
+ * Rolling-window operation on a column of a distributed matrix,
+ * producing a new single-column matrix in row order. Output blocks
+ * line up row for row with the input blocks.
+ *
+ * Each block is processed independently in parallel; the last
+ * window-1 rows before the block (which may span several preceding
+ * blocks) are handed to the kernel as a zero-copy slice.
+ *
+ * The templated type, T, must have the following traits:
+ *   1. Define a nested type named Args with a `window` member.
+ *   2. Define function apply(history, block, args, out): write one
+ *      output value per block row, where history holds the up to
+ *      window-1 rows preceding the block.
+ */
+template<typename T>
+class WindowOperation {
+ public:
+  /**
+   * Apply the templated window operation to matrix subject to args.
+   *
+   * @param matrix - Matrix to scan.
+   * @param args - Operation arguments.
+   * @param context - Query priority and cancellation handle.
+   * @return - Single-column matrix of window results.
+   */
+  std::unique_ptr<DMatrix> apply(DMatrix& matrix, typename T::Args args,
+                                 std::shared_ptr<QueryContext> context =
+                                     std::make_shared<QueryContext>()) {
+    if (args.window < 1) {
+      throw std::invalid_argument("window must be at least one row");
+    }
+
+    auto const &blocks = matrix.getMemoryBlocks();
+    std::vector<std::shared_ptr<MemoryBlock>> outBlocks(blocks.size());
+    pool.parallelFor(context, blocks.size(), [&](size_t i) {
+        long start = matrix.getStartRow(i);
+        long historyStart = std::max(0L, start - (args.window - 1));
+        MatrixSlice history = matrix.slice(historyStart, start);
+
+        long rows = blocks[i]->getBlockData().getRows();
+        BlockBuffer out = BlockAllocator::instance().allocate(rows);
+        t.apply(history, *blocks[i], args, out.get());
+        outBlocks[i] = columnBlock(rows, std::move(out));
+      });
+
+    std::vector<std::shared_ptr<RemoteBlock>> empty;
+    return std::make_unique<DMatrix>(outBlocks, empty, 1);
+  }
+
+ private:
+  T t;
+};
+
+/**
+ * Column values of a window's history followed by its block, addressed
+ * as one sequence. The history is copied (it is at most window-1
+ * values); block values are read in place.
+ */
+class WindowSequence {
+ public:
+  WindowSequence(const MatrixSlice& history, const MemoryBlock& block,
+                 int col)
+      : data(block.getBlockData().getData() + col),
+        cols(block.getBlockData().getCols()),
+        rows(block.getBlockData().getRows()) {
+
+    for (auto const &segment : history.getSegments()) {
+      const double* values = segment.getData() + col;
+      for (long i=0; i<segment.getRows(); i++) {
+        prefix.push_back(values[i * history.getCols()]);
+      }
+    }
+  }
+
+  /// Number of history values before the block's first row.
+  long getOffset() const { return prefix.size(); }
+
+  /// Total number of values (history and block).
+  long size() const { return prefix.size() + rows; }
+
+  /// Value at position k of the sequence.
+  double operator[](long k) const {
+    long h = prefix.size();
+    return k < h ? prefix[k] : data[(k - h) * cols];
+  }
+
+ private:
+  std::vector<double> prefix;
+  const double* data;
+  long cols;
+  long rows;
+};
+
+class CumulativeSum {
+ public:
+  struct Args {
+    Args(int col) : col(col) {}
+    const int col;
+  };
+
+  typedef double Carry;
+
+  Carry identity() { return 0; }
+
+  Carry reduce(const MemoryBlock& block, const Args& args) {
+    auto const &blockData = block.getBlockData();
+    auto const data = blockData.getData();
+    double sum = 0;
+    for (long i=0; i<blockData.getRows(); i++) {
+      sum += data[i * blockData.getCols() + args.col];
+    }
+    return sum;
+  }
+
+  Carry combine(Carry a, Carry b) { return a + b; }
+
+  void scan(const MemoryBlock& block, const Args& args, Carry carry,
+            double* out) {
+    auto const &blockData = block.getBlockData();
+    auto const data = blockData.getData();
+    for (long i=0; i<blockData.getRows(); i++) {
+      carry += data[i * blockData.getCols() + args.col];
+      out[i] = carry;
+    }
+  }
+};
+
+/**
+ * Running extreme of a column; Compare(a, b) is true when a should
+ * replace b (std::less for minimum, std::greater for maximum).
+ */
+template<typename Compare>
+class CumulativeExtreme {
+ public:
+  struct Args {
+    Args(int col) : col(col) {}
+    const int col;
+  };
+
+  typedef double Carry;
+
+  Carry identity() {
+    return Compare()(0, 1) ? std::numeric_limits<double>::infinity()
+                           : -std::numeric_limits<double>::infinity();
+  }
+
+  Carry reduce(const MemoryBlock& block, const Args& args) {
+    auto const &blockData = block.getBlockData();
+    auto const data = blockData.getData();
+    double extreme = identity();
+    for (long i=0; i<blockData.getRows(); i++) {
+      extreme = combine(extreme, data[i * blockData.getCols() + args.col]);
+    }
+    return extreme;
+  }
+
+  Carry combine(Carry a, Carry b) { return Compare()(b, a) ? b : a; }
+
+  void scan(const MemoryBlock& block, const Args& args, Carry carry,
+            double* out) {
+    auto const &blockData = block.getBlockData();
+    auto const data = blockData.getData();
+    for (long i=0; i<blockData.getRows(); i++) {
+      carry = combine(carry, data[i * blockData.getCols() + args.col]);
+      out[i] = carry;
+    }
+  }
+};
+
+typedef CumulativeExtreme<std::less<double>> CumulativeMin;
+typedef CumulativeExtreme<std::greater<double>> CumulativeMax;
+
+/**
+ * Sum (or mean) of the last `window` values of a column. Windows at
+ * the start of the matrix cover the rows available so far.
+ */
+template<bool Mean>
+class RollingTotal {
+ public:
+  struct Args {
+    Args(int col, long window) : col(col), window(window) {}
+    const int col;
+    const long window;
+  };
+
+  void apply(const MatrixSlice& history, const MemoryBlock& block,
+             const Args& args, double* out) {
+    WindowSequence values(history, block, args.col);
+    long h = values.getOffset();
+
+    double sum = 0;
+    for (long k=0; k<h; k++) {
+      sum += values[k];
+    }
+
+    for (long k=h; k<values.size(); k++) {
+      sum += values[k];
+      if (k >= args.window) {
+        sum -= values[k - args.window];
+      }
+      out[k - h] = Mean ? sum / std::min(args.window, k + 1) : sum;
+    }
+  }
+};
+
+typedef RollingTotal<false> RollingSum;
+typedef RollingTotal<true> RollingMean;
+
+/**
+ * Minimum (or maximum) of the last `window` values of a column,
+ * computed in O(1) amortized per row with a monotonic deque of
+ * candidate positions. Windows at the start of the matrix cover the
+ * rows available so far.
+ */
+template<typename Compare>
+class RollingExtreme {
+ public:
+  struct Args {
+    Args(int col, long window) : col(col), window(window) {}
+    const int col;
+    const long window;
+  };
+
+  void apply(const MatrixSlice& history, const MemoryBlock& block,
+             const Args& args, double* out) {
+    Compare compare;
+    WindowSequence values(history, block, args.col);
+    long h = values.getOffset();
+
+    // Positions whose values are strictly better than every later
+    // position in the deque; the front is the current extreme.
+    std::deque<long> candidates;
+    for (long k=0; k<values.size(); k++) {
+      double value = values[k];
+      while (!candidates.empty() && !compare(values[candidates.back()], value)) {
+        candidates.pop_back();
+      }
+      candidates.push_back(k);
+
+      if (candidates.front() <= k - args.window) {
+        candidates.pop_front();
+      }
+
+      if (k >= h) {
+        out[k - h] = values[candidates.front()];
+      }
+    }
+  }
+};
+
+typedef RollingExtreme<std::less<double>> RollingMin;
+typedef RollingExtreme<std::greater<double>> RollingMax;
+
+
+ScanOperation<CumulativeSum> CUMSUM;
+ScanOperation<CumulativeMin> CUMMIN;
+ScanOperation<CumulativeMax> CUMMAX;
+WindowOperation<RollingSum> ROLLING_SUM;
+WindowOperation<RollingMean> ROLLING_MEAN;
+WindowOperation<RollingMin> ROLLING_MIN;
+WindowOperation<RollingMax> ROLLING_MAX;
+
+}
+
+#endif
@@ -1,24 +1,79 @@
 #ifndef THREAD_POOL_H
 #define THREAD_POOL_H
 
+#include <atomic>
 #include <condition_variable>
 #include <functional>
 #include <future>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <queue>
+#include <stdexcept>
 #include <thread>
+#include <vector>
 
 namespace Multitude {
 
+/**
+ * Priority class of a query. The value is the query's scheduling
+ * weight: a HIGH query receives 4x the worker time of a NORMAL one
+ * while both have queued tasks.
+ */
+enum class Priority : int {
+  LOW = 1,
+  NORMAL = 4,
+  HIGH = 16
+};
+
+/**
+ * Raised by tasks of a query that was cancelled before they ran.
+ */
+class QueryCancelled : public std::runtime_error {
+ public:
+  QueryCancelled() : std::runtime_error("query cancelled") {}
+};
+
+/**
+ * Scheduling context shared by all tasks of one query.
+ */
+class QueryContext {
+ public:
+  QueryContext(Priority priority = Priority::NORMAL)
+      : priority(priority), cancelled(false) {}
+
+  /// Priority class of the query.
+  Priority getPriority() const { return priority; }
+
+  /// Scheduling weight derived from the priority class.
+  int getWeight() const { return static_cast<int>(priority); }
+
+  /// Cancel the query; tasks which have not started yet will not run.
+  void cancel() { cancelled = true; }
+
+  /// Whether the query has been cancelled.
+  bool isCancelled() const { return cancelled; }
+
+ private:
+  const Priority priority;
+  std::atomic<bool> cancelled;
+};
+
 /**
  * Task-based thread pool.
  *
- * Tasks submitted to the pool are executed as soon as a free
- * worker thread is available (FIFO).
+ * Tasks are queued per query (QueryContext) and the queries are
+ * served weighted-fair by priority (stride scheduling): each query
+ * advances a virtual clock by 1/weight for every task it runs, and a
+ * free worker always takes the next task of the query with the
+ * smallest clock. Tasks of the same query run FIFO, so a large scan
+ * cannot starve small queries submitted after it.
  */
 class ThreadPool {
  public:
-  ThreadPool(int numThreads) : running(true) {
+  ThreadPool(int numThreads)
+      : running(true), virtualTime(0),
+        defaultContext(std::make_shared<QueryContext>()) {
     for (int i=0; i<numThreads; i++) {
       threads.push_back(std::thread([&] {
             while (true) {
@@ -27,12 +82,11 @@ class ThreadPool {
                 std::unique_lock<std::mutex> lock(mutex);
                 if (!running) {
                   return;
-                } else if (workQueue.empty()) {
+                } else if (queries.empty()) {
                   cond.wait(lock);
                   continue;
                 } else {
-                  task = workQueue.front();
-                  workQueue.pop();
+                  task = next();
                 }
               }
               try {
@@ -44,7 +98,10 @@ class ThreadPool {
   }
 
   ~ThreadPool() {
-    running = false;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      running = false;
+    }
     cond.notify_all();
     for (auto &thread : threads) {
       thread.join();
@@ -52,17 +109,36 @@ class ThreadPool {
   }
 
   /**
-   * Schedule a task to run on the thread pool (FIFO).
+   * Schedule a task to run on the thread pool as part of the
+   * pool's default query.
    *
    * @param task - Task to execute on the thread pool.
    * @return - Future of task's result.
    */
   template<typename T>
   std::future<T> schedule(std::function<T ()> task) {
+    return schedule(defaultContext, task);
+  }
+
+  /**
+   * Schedule a task to run on the thread pool as part of a query.
+   * If the query is cancelled before the task starts, the future
+   * holds a QueryCancelled exception.
+   *
+   * @param context - Query the task belongs to.
+   * @param task - Task to execute on the thread pool.
+   * @return - Future of task's result.
+   */
+  template<typename T>
+  std::future<T> schedule(std::shared_ptr<QueryContext> context,
+                          std::function<T ()> task) {
     auto promise = std::make_shared<std::promise<T>>();
 
     std::function<void ()> workerFn = [=]() {
       try {
+        if (context->isCancelled()) {
+          throw QueryCancelled();
+        }
         T value = task();
         promise->set_value(value);
       } catch (...) {
@@ -70,23 +146,107 @@ class ThreadPool {
       }
     };
 
-    {
-      std::unique_lock<std::mutex> lock(mutex);
-      workQueue.push(workerFn);
-      cond.notify_one();
+    submit(context, workerFn);
+    return promise->get_future();
+  }
+
+  /**
+   * Run fn(0) ... fn(n-1) on the pool as part of a query and wait for
+   * all of them. Rethrows the first failure once every task is done.
+   * Must not be called from a pool task.
+   *
+   * @param context - Query the tasks belong to.
+   * @param n - Number of tasks.
+   * @param fn - Task body, called with the task index.
+   */
+  void parallelFor(std::shared_ptr<QueryContext> context, size_t n,
+                   std::function<void (size_t)> fn) {
+    std::vector<std::future<bool>> futures;
+    for (size_t i=0; i<n; i++) {
+      std::function<bool ()> task = [fn, i]() {
+        fn(i);
+        return true;
+      };
+      futures.push_back(schedule(context, task));
     }
 
-    return promise->get_future();
-  };
+    for (auto &future : futures) {
+      future.wait();
+    }
+    for (auto &future : futures) {
+      future.get();
+    }
+  }
+
+  /**
+   * Enqueue a raw task for a query. The task is responsible for
+   * reporting its own result and checking for cancellation.
+   *
+   * @param context - Query the task belongs to.
+   * @param task - Task to execute on the thread pool.
+   */
+  void submit(std::shared_ptr<QueryContext> context,
+              std::function<void ()> task) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto it = queries.find(context.get());
+    if (it == queries.end()) {
+      // A query joining (or re-joining) the pool starts at the current
+      // virtual time so it can neither bank nor owe worker time.
+      it = queries.emplace(context.get(),
+                           QueryQueue(context, virtualTime)).first;
+    }
+
+    it->second.tasks.push(task);
+    cond.notify_one();
+  }
 
  private:
   ThreadPool(ThreadPool const&) = delete;
   void operator=(ThreadPool const&) = delete;
 
+  /**
+   * Pending tasks of one query and its position on the virtual clock.
+   */
+  struct QueryQueue {
+    QueryQueue(std::shared_ptr<QueryContext> context, double pass)
+        : context(context), pass(pass) {}
+
+    std::shared_ptr<QueryContext> context;
+    std::queue<std::function<void ()>> tasks;
+    double pass;
+  };
+
+  /**
+   * Dequeue the next task of the query with the smallest virtual
+   * clock. Must be called with the lock held and a non-empty queue.
+   */
+  std::function<void ()> next() {
+    auto selected = queries.begin();
+    for (auto it = queries.begin(); it != queries.end(); ++it) {
+      if (it->second.pass < selected->second.pass) {
+        selected = it;
+      }
+    }
+
+    QueryQueue &query = selected->second;
+    std::function<void ()> task = query.tasks.front();
+    query.tasks.pop();
+    virtualTime = query.pass;
+    query.pass += 1.0 / query.context->getWeight();
+
+    if (query.tasks.empty()) {
+      queries.erase(selected);
+    }
+
+    return task;
+  }
+
   bool running;
+  double virtualTime;
+  std::shared_ptr<QueryContext> defaultContext;
   std::mutex mutex;
   std::condition_variable cond;
-  std::queue<std::function<void ()>> workQueue;
+  std::map<QueryContext*, QueryQueue> queries;
   std::vector<std::thread> threads;
 };
 
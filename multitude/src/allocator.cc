@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <sys/mman.h>
+#include "../include/allocator.h"
+
+#define CACHE_LINE 64
+#define SMALL_PAGE 4096
+#define HUGE_PAGE (2L * 1024 * 1024)
+#define DEFAULT_MAX_POOLED (64L * 1024 * 1024)
+#define MAX_SLACK_DIVISOR 4  // Reuse buffers up to 1/4 larger than asked.
+
+namespace Multitude {
+
+void BufferDeleter::operator()(double* data) const {
+  if (bytes == 0) {
+    delete[] data;
+  } else {
+    BlockAllocator::instance().release(data, bytes);
+  }
+}
+
+BlockAllocator& BlockAllocator::instance() {
+  // Never destroyed: buffers held by static objects may be released
+  // after static destructors have run.
+  static BlockAllocator* allocator = new BlockAllocator;
+  return *allocator;
+}
+
+BlockAllocator::BlockAllocator()
+    : hugePages(HugePages::TRANSPARENT), maxPooledBytes(DEFAULT_MAX_POOLED),
+      pooledBytes(0) {}
+
+BlockBuffer BlockAllocator::allocate(size_t doubles) {
+  size_t bytes = std::max<size_t>(doubles * sizeof(double), CACHE_LINE);
+  size_t unit = bytes >= HUGE_PAGE ? HUGE_PAGE : SMALL_PAGE;
+  bytes = (bytes + unit - 1) / unit * unit;
+
+  {
+    // Smallest pooled buffer that fits, unless it wastes too much.
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = pool.lower_bound(bytes);
+    if (it != pool.end() && it->first <= bytes + bytes / MAX_SLACK_DIVISOR) {
+      size_t capacity = it->first;
+      void* data = it->second.back();
+      it->second.pop_back();
+      if (it->second.empty()) {
+        pool.erase(it);
+      }
+      pooledBytes -= capacity;
+      return BlockBuffer((double*)data, BufferDeleter(capacity));
+    }
+  }
+
+  void* data = NULL;
+  if (bytes >= HUGE_PAGE) {
+    data = map(bytes);
+  } else if (posix_memalign(&data, CACHE_LINE, bytes) != 0) {
+    data = NULL;
+  }
+
+  if (data == NULL) {
+    throw std::bad_alloc();
+  }
+
+  return BlockBuffer((double*)data, BufferDeleter(bytes));
+}
+
+void BlockAllocator::release(double* data, size_t bytes) {
+  if (data == NULL) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (pooledBytes + bytes <= maxPooledBytes) {
+      pool[bytes].push_back(data);
+      pooledBytes += bytes;
+      return;
+    }
+  }
+
+  unmap(data, bytes);
+}
+
+void BlockAllocator::setHugePages(HugePages mode) {
+  std::lock_guard<std::mutex> lock(mutex);
+  hugePages = mode;
+}
+
+void BlockAllocator::setMaxPooledBytes(size_t bytes) {
+  std::lock_guard<std::mutex> lock(mutex);
+  maxPooledBytes = bytes;
+}
+
+size_t BlockAllocator::getPooledBytes() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return pooledBytes;
+}
+
+void BlockAllocator::trim() {
+  std::map<size_t, std::vector<void*>> buffers;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    buffers.swap(pool);
+    pooledBytes = 0;
+  }
+
+  for (auto const &entry : buffers) {
+    for (void* data : entry.second) {
+      unmap(data, entry.first);
+    }
+  }
+}
+
+/**
+ * Map a 2MB-aligned region of whole huge pages.
+ */
+void* BlockAllocator::map(size_t bytes) {
+  HugePages mode;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    mode = hugePages;
+  }
+
+#ifdef MAP_HUGETLB
+  if (mode == HugePages::EXPLICIT) {
+    void* data = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (data != MAP_FAILED) {
+      return data;
+    }
+  }
+#endif
+
+  // Over-map by one huge page and trim both ends to align the region.
+  size_t mapped = bytes + HUGE_PAGE;
+  void* region = mmap(NULL, mapped, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (region == MAP_FAILED) {
+    return NULL;
+  }
+
+  uintptr_t start = (uintptr_t)region;
+  uintptr_t aligned = (start + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+  if (aligned > start) {
+    munmap(region, aligned - start);
+  }
+  if (aligned + bytes < start + mapped) {
+    munmap((void*)(aligned + bytes), start + mapped - aligned - bytes);
+  }
+
+#ifdef MADV_HUGEPAGE
+  if (mode != HugePages::NONE) {
+    madvise((void*)aligned, bytes, MADV_HUGEPAGE);
+  }
+#endif
+
+  return (void*)aligned;
+}
+
+/**
+ * Return a buffer to the system.
+ */
+void BlockAllocator::unmap(void* data, size_t bytes) {
+  if (bytes >= HUGE_PAGE) {
+    munmap(data, bytes);
+  } else {
+    free(data);
+  }
+}
+
+}
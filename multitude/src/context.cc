@@ -1,22 +1,73 @@
-#include <cmath>
-#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <functional>
 #include <future>
-#include <iostream>
+#include <glob.h>
+#include <libgen.h>
+#include <map>
 #include <memory>
+#include <stdexcept>
 #include <string>
+#include <sys/stat.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
 #include <vector>
+#include "../include/allocator.h"
 #include "../include/block.h"
 #include "../include/context.h"
 #include "../include/matrix.h"
 
 #define MIN_BLOCK 64000
 #define HEADER_SIZE sizeof(int)
-#define ID_LENGTH 64
 
 namespace Multitude {
 
+/**
+ * File statistics of multitude-encoded binary file.
+ */
+struct FileStats {
+  FileStats(int cols, long size) : cols(cols), size(size) {}
+  int cols;   ///< Number of columns in the matrix.
+  long size;  ///< Total size of file in bytes.
+
+  /// Bytes per matrix row.
+  long rowBytes() const { return cols * sizeof(double); }
+
+  /// Number of complete rows in the file.
+  long rows() const { return (size - (long)HEADER_SIZE) / rowBytes(); }
+};
+
 // Block loading functions.
-std::vector<std::shared_ptr<MemoryBlock>> loadToMemory(std::string path);
+std::unique_ptr<DMatrix> loadToMemory(std::vector<std::string> paths,
+                                      int concurrency);
+std::vector<std::unique_ptr<BlockDescriptor>> planBlocks(
+    std::string path, const FileStats& fileStats, long firstRow,
+    long blockRows);
+std::vector<std::shared_ptr<MemoryBlock>> loadBlocks(
+    int cols, std::vector<std::unique_ptr<BlockDescriptor>> descriptors,
+    int concurrency);
+std::shared_ptr<MemoryBlock> loadFromDescriptor(
+    int cols, std::unique_ptr<BlockDescriptor> descriptor);
+
+// File stats utilities.
+FileStats stat(std::string path);
+long targetBlockRows(int cols, long totalRows);
+std::vector<std::string> listShards(std::string pattern);
+
+// File I/O utilities.
+void runBounded(size_t n, int concurrency, std::function<void (size_t)> fn);
+void readAt(int fd, char* data, long length, long offset);
+void writeAt(int fd, const char* data, long length, long offset);
+void syncDirectory(std::string path);
+
+DContext::DContext(int maxConcurrentReads)
+    : maxConcurrentReads(maxConcurrentReads > 0
+                         ? maxConcurrentReads
+                         : std::thread::hardware_concurrency()) {}
 
 /**
  * Loads a distributed matrix which is contained in the binary
@@ -26,145 +77,510 @@ std::vector<std::shared_ptr<MemoryBlock>> loadToMemory(std::string path);
  * @return - Distributed matrix.
  */
 std::unique_ptr<DMatrix> DContext::binaryFile(std::string path) {
-  auto memoryBlocks = loadToMemory(path);
+  return binaryFiles({path});
+}
+
+/**
+ * Loads a distributed matrix stored as a sequence of binary files
+ * (shards). Rows are ordered shard by shard in the order given.
+ *
+ * @param paths - Input paths.
+ * @return - Distributed matrix.
+ */
+std::unique_ptr<DMatrix> DContext::binaryFiles(std::vector<std::string> paths) {
+  return loadToMemory(paths, maxConcurrentReads);
+}
+
+/**
+ * Loads a distributed matrix stored as shards in a directory (every
+ * non-empty regular file in it whose name does not start with '.' or
+ * '_') or matching a glob pattern. Shards are ordered by path.
+ *
+ * @param pattern - Directory or glob pattern.
+ * @return - Distributed matrix.
+ */
+std::unique_ptr<DMatrix> DContext::shardedFiles(std::string pattern) {
+  return binaryFiles(listShards(pattern));
+}
+
+/**
+ * Load rows appended to a matrix's files since they were loaded. For
+ * every source file of the matrix, complete rows past its loaded end
+ * are read as new blocks and placed after the blocks of that file (and
+ * of the files before it), so the matrix stays in file row order and
+ * existing blocks (and their ids) are kept. Files that had no rows at
+ * load time are picked up too. Must not run concurrently with
+ * operations on the matrix.
+ *
+ * @param matrix - Matrix loaded from binary files.
+ * @return - Number of rows added.
+ */
+long DContext::refresh(DMatrix& matrix) {
+  auto const &blocks = matrix.getMemoryBlocks();
+  auto sources = matrix.getSources();
+  std::map<std::string, size_t> sourceOf;
+  for (size_t s=0; s<sources.size(); s++) {
+    sourceOf[sources[s].path] = s;
+  }
+
+  // Position of the last block of every source file (-1 if none).
+  std::vector<long> lastBlock(sources.size(), -1);
+  for (size_t i=0; i<blocks.size(); i++) {
+    auto const &descriptor = blocks[i]->getDescriptor();
+    if (!descriptor.hasLocation()) {
+      continue;
+    }
+
+    auto it = sourceOf.find(descriptor.getLocation().getPath());
+    if (it != sourceOf.end()) {
+      lastBlock[it->second] = i;
+    }
+  }
+
+  // New blocks of a file go after the last block of that file or of
+  // any file before it (-1: at the front).
+  std::vector<std::unique_ptr<BlockDescriptor>> descriptors;
+  std::vector<long> positions;
+  long newRows = 0;
+  long after = -1;
+  for (size_t s=0; s<sources.size(); s++) {
+    after = std::max(after, lastBlock[s]);
+    auto const &path = sources[s].path;
+    FileStats stats = stat(path);
+    if (stats.cols != matrix.getCols()) {
+      throw std::runtime_error(path + " changed column count");
+    }
+
+    long firstRow = (sources[s].end - (long)HEADER_SIZE) / stats.rowBytes();
+    long rows = stats.rows() - firstRow;
+    if (rows <= 0) {
+      continue;
+    }
+
+    newRows += rows;
+    for (auto &descriptor : planBlocks(path, stats, firstRow,
+                                       targetBlockRows(stats.cols, rows))) {
+      descriptors.push_back(std::move(descriptor));
+      positions.push_back(after);
+    }
+    sources[s].end = HEADER_SIZE + stats.rows() * stats.rowBytes();
+  }
+
+  if (descriptors.empty()) {
+    return 0;
+  }
+
+  auto tail = loadBlocks(matrix.getCols(), std::move(descriptors),
+                         maxConcurrentReads);
+
+  std::vector<std::shared_ptr<MemoryBlock>> refreshed;
+  size_t next = 0;
+  for (; next < tail.size() && positions[next] < 0; next++) {
+    refreshed.push_back(tail[next]);
+  }
+  for (size_t i=0; i<blocks.size(); i++) {
+    refreshed.push_back(blocks[i]);
+    for (; next < tail.size() && positions[next] == (long)i; next++) {
+      refreshed.push_back(tail[next]);
+    }
+  }
+
+  matrix.setMemoryBlocks(refreshed);
+  matrix.setSources(sources);
+  return newRows;
+}
+
+/**
+ * Save a distributed matrix to a multitude binary file. Block
+ * offsets are known up front, so blocks are written concurrently
+ * with pwrite. With atomic set, data is written to a temporary file
+ * next to path which replaces path only once it is complete. A matrix
+ * without rows is saved as a header-only file; one whose column count
+ * is unknown cannot be saved.
+ *
+ * @param matrix - Matrix to save.
+ * @param path - Output path.
+ * @param sync - Whether to flush the file to disk before completing.
+ * @param atomic - Whether to write through a temporary file + rename.
+ */
+void DContext::save(DMatrix& matrix, std::string path, SyncPolicy sync,
+                    bool atomic) {
+  auto const &blocks = matrix.getMemoryBlocks();
+  int cols = matrix.getCols();
+  if (cols <= 0) {
+    // A header of zero columns would not load back.
+    throw std::invalid_argument("cannot save a matrix of unknown columns");
+  }
+
+  std::vector<long> offsets;
+  long size = HEADER_SIZE;
+  for (auto const &block : blocks) {
+    auto const &blockData = block->getBlockData();
+    if (blockData.getCols() != cols) {
+      throw std::invalid_argument("blocks have differing column counts");
+    }
+    offsets.push_back(size);
+    size += blockData.getRows() * blockData.getCols() * sizeof(double);
+  }
+
+  // The temporary file is hidden so shard listings never pick it up.
+  static std::atomic<long> tmpId(0);
+  size_t slash = path.rfind('/');
+  size_t nameStart = slash == std::string::npos ? 0 : slash + 1;
+  std::string target = atomic ? path.substr(0, nameStart) + "." +
+                                path.substr(nameStart) + ".tmp-" +
+                                std::to_string(getpid()) + "-" +
+                                std::to_string(tmpId++)
+                              : path;
+
+  int fd = open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "cannot create " + target);
+  }
+
+  try {
+    if (ftruncate(fd, size) != 0) {
+      throw std::system_error(errno, std::generic_category(),
+                              "cannot size " + target);
+    }
+
+    writeAt(fd, (const char*)&cols, HEADER_SIZE, 0);
+    runBounded(blocks.size(), std::thread::hardware_concurrency(),
+               [&](size_t i) {
+      auto const &blockData = blocks[i]->getBlockData();
+      long length = blockData.getRows() * blockData.getCols() * sizeof(double);
+      writeAt(fd, (const char*)blockData.getData(), length, offsets[i]);
+    });
+
+    if (sync == SyncPolicy::DATA && fdatasync(fd) != 0) {
+      throw std::system_error(errno, std::generic_category(),
+                              "cannot sync " + target);
+    } else if (sync == SyncPolicy::FULL && fsync(fd) != 0) {
+      throw std::system_error(errno, std::generic_category(),
+                              "cannot sync " + target);
+    }
+  } catch (...) {
+    close(fd);
+    if (atomic) {
+      unlink(target.c_str());
+    }
+    throw;
+  }
+
+  if (close(fd) != 0) {
+    if (atomic) {
+      unlink(target.c_str());
+    }
+    throw std::system_error(errno, std::generic_category(),
+                            "cannot close " + target);
+  }
+
+  if (atomic && rename(target.c_str(), path.c_str()) != 0) {
+    int error = errno;
+    unlink(target.c_str());
+    throw std::system_error(error, std::generic_category(),
+                            "cannot rename " + target + " to " + path);
+  }
+
+  if (sync == SyncPolicy::FULL) {
+    syncDirectory(path);
+  }
+}
+
+/**
+ * Load binary files into memory as a matrix of MemoryBlocks. All
+ * files are validated before any data is read, then split into
+ * similarly sized blocks (never crossing a file boundary) which are
+ * read with at most `concurrency` reads in flight.
+ *
+ * @param paths - Paths to binary matrix files.
+ * @param concurrency - Maximum number of concurrent reads.
+ * @return - Matrix with the files' column count, even without rows.
+ */
+std::unique_ptr<DMatrix> loadToMemory(std::vector<std::string> paths,
+                                      int concurrency) {
+  if (paths.empty()) {
+    throw std::invalid_argument("no input files");
+  }
+
+  std::vector<FileStats> stats;
+  long totalRows = 0;
+  for (auto const &path : paths) {
+    stats.push_back(stat(path));
+    if (stats.back().cols != stats.front().cols) {
+      throw std::runtime_error(path + " has " +
+                               std::to_string(stats.back().cols) +
+                               " columns, expected " +
+                               std::to_string(stats.front().cols));
+    }
+    totalRows += stats.back().rows();
+  }
+
+  int cols = stats.front().cols;
+  long blockRows = targetBlockRows(cols, totalRows);
+  std::vector<std::unique_ptr<BlockDescriptor>> descriptors;
+  for (size_t i=0; i<paths.size(); i++) {
+    for (auto &descriptor : planBlocks(paths[i], stats[i], 0, blockRows)) {
+      descriptors.push_back(std::move(descriptor));
+    }
+  }
+
+  std::vector<SourceFile> sources;
+  for (size_t i=0; i<paths.size(); i++) {
+    long end = HEADER_SIZE + stats[i].rows() * stats[i].rowBytes();
+    sources.push_back({paths[i], end});
+  }
+
+  auto memoryBlocks = loadBlocks(cols, std::move(descriptors), concurrency);
   std::vector<std::shared_ptr<RemoteBlock>> empty;
-  return std::make_unique<DMatrix>(memoryBlocks, empty);
+  auto matrix = std::make_unique<DMatrix>(memoryBlocks, empty, cols);
+  matrix->setSources(sources);
+  return matrix;
 }
 
 /**
- * File statistics of multitude-encoded binary file.
+ * Split the rows [firstRow, rows) of a file into blocks of about
+ * blockRows rows each, spreading any remainder evenly.
  */
-struct FileStats {
-  FileStats(int cols, long size) : cols(cols), size(size) {}
-  int cols;   ///< Number of columns in the matrix.
-  long size;  ///< Total size of file in bytes.
-};
+std::vector<std::unique_ptr<BlockDescriptor>> planBlocks(
+    std::string path, const FileStats& fileStats, long firstRow,
+    long blockRows) {
+  std::vector<std::unique_ptr<BlockDescriptor>> descriptors;
+  long rows = fileStats.rows() - firstRow;
+  if (rows <= 0) {
+    return descriptors;
+  }
 
-// File stats utilities.
-std::unique_ptr<FileStats> stat(std::string path);
-std::string nextBlockId();
-int determineNumBlocks(FileStats& fileStats);
-long getBlockSize(FileStats& fileStats, int numBlocks);
+  long numBlocks = (rows + blockRows - 1) / blockRows;
+  long row = firstRow;
+  for (long i=0; i<numBlocks; i++) {
+    long n = rows / numBlocks + (i < rows % numBlocks ? 1 : 0);
+    long offset = HEADER_SIZE + row * fileStats.rowBytes();
+    auto location = std::make_shared<DataLocation>(
+        path, offset, n * fileStats.rowBytes());
+    descriptors.push_back(std::make_unique<BlockDescriptor>(location));
+    row += n;
+  }
 
+  return descriptors;
+}
+
+/**
+ * Load planned blocks with bounded read concurrency.
+ */
+std::vector<std::shared_ptr<MemoryBlock>> loadBlocks(
+    int cols, std::vector<std::unique_ptr<BlockDescriptor>> descriptors,
+    int concurrency) {
+  std::vector<std::shared_ptr<MemoryBlock>> blocks(descriptors.size());
+  runBounded(descriptors.size(), concurrency, [&](size_t i) {
+      blocks[i] = loadFromDescriptor(cols, std::move(descriptors[i]));
+    });
+  return blocks;
+}
 
 /**
  * Load a memory block from file and block descriptor.
  */
 std::shared_ptr<MemoryBlock> loadFromDescriptor(
-    const FileStats& fileStats,
-    std::unique_ptr<BlockDescriptor> descriptor) {
+    int cols, std::unique_ptr<BlockDescriptor> descriptor) {
 
-  auto location = descriptor->getLocation();
+  auto const &location = descriptor->getLocation();
 
-  long rowBytes = fileStats.cols * sizeof(double);
+  long rowBytes = cols * sizeof(double);
   long rows = location.getLength() / rowBytes;
   long doubles = location.getLength() / sizeof(double);
 
-  auto data = std::make_unique<double[]>(doubles);
-  std::ifstream file(location.getPath(), std::ios::in | std::ios::binary);
-  file.seekg(location.getOffset());
-  file.read((char*)data.get(), location.getLength());
+  BlockBuffer data = BlockAllocator::instance().allocate(doubles);
+  int fd = open(location.getPath().c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "cannot open " + location.getPath());
+  }
+
+  try {
+    readAt(fd, (char*)data.get(), location.getLength(), location.getOffset());
+  } catch (...) {
+    close(fd);
+    throw;
+  }
+  close(fd);
 
-  auto blockData = std::make_unique<BlockData>(rows, fileStats.cols,
-                                               std::move(data));
+  auto blockData = std::make_unique<BlockData>(rows, cols, std::move(data));
   return std::make_shared<MemoryBlock>(nextBlockId(),
                                        std::move(descriptor),
                                        std::move(blockData));
 }
 
 /**
- * Load a local file into memory as a sequence of MemoryBlocks.
- *
- * @param path - Path to binary matrix file.
- * @return - Vector of memory blocks.
+ * Get stats of multitude-encoded binary file. A trailing partial row
+ * (e.g. one still being written) is not counted in rows().
  */
-std::vector<std::shared_ptr<MemoryBlock>> loadToMemory(std::string path) {
-  std::unique_ptr<FileStats> fileStats = stat(path);
-  FileStats& statsRef = *fileStats;
-  int numBlocks = determineNumBlocks(*fileStats);
-  long blockSize = getBlockSize(*fileStats, numBlocks);
-  std::vector<std::future<std::shared_ptr<MemoryBlock>>> blockFutures;
-
-  for (int i=0; i<numBlocks; i++) {
-    long offset = HEADER_SIZE + i * blockSize;
-    long length = (i == numBlocks-1) ? fileStats->size - offset : blockSize;
-    auto location = std::make_shared<DataLocation>(path, offset, length);
-    auto descriptor = std::make_unique<BlockDescriptor>(location);
-    auto blockFuture = std::async(std::launch::async, loadFromDescriptor,
-                                  statsRef, std::move(descriptor));
-    std::cout << i << std::endl;
-    blockFutures.push_back(std::move(blockFuture));
+FileStats stat(std::string path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "cannot open " + path);
   }
 
-  std::vector<std::shared_ptr<MemoryBlock>> blocks;
-  for (auto &blockFuture : blockFutures) {
-    blocks.push_back(blockFuture.get());
+  struct stat st;
+  int cols = 0;
+  bool ok = fstat(fd, &st) == 0 && st.st_size >= (long)HEADER_SIZE &&
+            pread(fd, &cols, HEADER_SIZE, 0) == (ssize_t)HEADER_SIZE;
+  close(fd);
+
+  if (!ok || cols <= 0) {
+    throw std::runtime_error(path + " is not a multitude binary file");
   }
 
-  return blocks;
+  return FileStats(cols, st.st_size);
+}
+
+/**
+ * Determine the number of rows per block: enough blocks to keep every
+ * core busy, but none smaller than MIN_BLOCK bytes.
+ */
+long targetBlockRows(int cols, long totalRows) {
+  long rowBytes = cols * sizeof(double);
+  long numCores = std::max(1U, std::thread::hardware_concurrency());
+  long minRows = (MIN_BLOCK + rowBytes - 1) / rowBytes;
+  return std::max(minRows, (totalRows + numCores - 1) / numCores);
 }
 
 /**
- * Get stats of multitude-encoded binary file.
+ * List shard files, sorted by path: every path matching a glob
+ * pattern, or the regular files of a directory except empty files and
+ * names starting with '.' or '_' (save's temporary files, markers).
  */
-std::unique_ptr<FileStats> stat(std::string path) {
-  std::ifstream file(path, std::ios::in | std::ios::binary);
-  if (!file.is_open()) {
-    return NULL;
+std::vector<std::string> listShards(std::string pattern) {
+  std::vector<std::string> paths;
+
+  struct stat st;
+  if (::stat(pattern.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+    DIR* dir = opendir(pattern.c_str());
+    if (dir == NULL) {
+      throw std::system_error(errno, std::generic_category(),
+                              "cannot open " + pattern);
+    }
+
+    while (struct dirent* entry = readdir(dir)) {
+      std::string name = entry->d_name;
+      if (name[0] == '.' || name[0] == '_') {
+        continue;  // Hidden/temporary files and markers such as _SUCCESS.
+      }
+
+      std::string path = pattern + "/" + name;
+      if (::stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode) &&
+          st.st_size >= (long)HEADER_SIZE) {
+        paths.push_back(path);
+      }
+    }
+    closedir(dir);
+  } else {
+    glob_t matches;
+    if (glob(pattern.c_str(), 0, NULL, &matches) == 0) {
+      for (size_t i=0; i<matches.gl_pathc; i++) {
+        paths.push_back(matches.gl_pathv[i]);
+      }
+    }
+    globfree(&matches);
+  }
+
+  if (paths.empty()) {
+    throw std::runtime_error("no files match " + pattern);
   }
 
-  int cols;
-  file.read((char*)&cols, sizeof(int));
-  file.seekg(0, file.end);
-  long size = file.tellg();
+  std::sort(paths.begin(), paths.end());
+  return paths;
+}
 
-  return std::make_unique<FileStats>(cols, size);
+long nextBlockId() {
+  static std::atomic<long> id(0);
+  return id++;
 }
 
 /**
- * Determine best number of blocks to load a file into.
+ * Run fn(0) ... fn(n-1) on at most `concurrency` threads and wait for
+ * all of them. Rethrows the first failure.
  */
-int determineNumBlocks(FileStats& fileStats) {
-  long numCores = std::thread::hardware_concurrency();
-  if (fileStats.size > numCores * MIN_BLOCK) {
-    return numCores;
+void runBounded(size_t n, int concurrency, std::function<void (size_t)> fn) {
+  std::atomic<size_t> next(0);
+  std::vector<std::future<void>> workers;
+  size_t numWorkers = std::min<size_t>(n, std::max(1, concurrency));
+  for (size_t w=0; w<numWorkers; w++) {
+    workers.push_back(std::async(std::launch::async, [&]() {
+          for (size_t i = next++; i < n; i = next++) {
+            fn(i);
+          }
+        }));
   }
 
-  return (int)(ceil(fileStats.size / MIN_BLOCK));
+  for (auto &worker : workers) {
+    worker.wait();
+  }
+  for (auto &worker : workers) {
+    worker.get();
+  }
 }
 
 /**
- * Determine the next unique block ID.
- *
- * @return - Unique block identifier.
+ * Read a buffer from a file offset, retrying short reads.
  */
-std::string nextBlockId() {
-  static const char alphanum[] =
-      "0123456789"
-      "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-      "abcdefghijklmnopqrstuvwxyz";
-
-  static const int n = sizeof(alphanum) - 1;
-
-  char s[ID_LENGTH+1];
-  for (int i = 0; i < ID_LENGTH; ++i) {
-    int idx = rand() / (RAND_MAX / n + 1);
-    s[i] = alphanum[idx];
+void readAt(int fd, char* data, long length, long offset) {
+  while (length > 0) {
+    ssize_t n = pread(fd, data, length, offset);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::system_error(errno, std::generic_category(), "read failed");
+    } else if (n == 0) {
+      throw std::runtime_error("unexpected end of file");
+    }
+    data += n;
+    offset += n;
+    length -= n;
   }
+}
 
-  s[ID_LENGTH] = 0;
-  return std::string(s);
+/**
+ * Write a buffer at a file offset, retrying short writes.
+ */
+void writeAt(int fd, const char* data, long length, long offset) {
+  while (length > 0) {
+    ssize_t written = pwrite(fd, data, length, offset);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::system_error(errno, std::generic_category(), "write failed");
+    }
+    data += written;
+    offset += written;
+    length -= written;
+  }
 }
 
 /**
- * Determine the block size for a file and target number of blocks.
+ * Flush a directory entry (e.g. a rename) of a file to disk.
  */
-long getBlockSize(FileStats& fileStats, int numBlocks) {
-  long rowBytes = fileStats.cols * sizeof(double);
-  long blockSize = fileStats.size / numBlocks;
+void syncDirectory(std::string path) {
+  std::vector<char> buffer(path.begin(), path.end());
+  buffer.push_back(0);
+  std::string dir = dirname(buffer.data());
 
-  // Round up to nearest multiple of rowBytes
-  return ((blockSize + rowBytes - 1) / rowBytes) * rowBytes;
+  int fd = open(dir.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "cannot open " + dir);
+  }
+  int result = fsync(fd);
+  int error = errno;
+  close(fd);
+  if (result != 0) {
+    throw std::system_error(error, std::generic_category(),
+                            "cannot sync " + dir);
+  }
 }
 
 }
@@ -1,4 +1,5 @@
-#include <map>
+#include <algorithm>
+#include <stdexcept>
 #include <string>
 #include <vector>
 #include "../include/block.h"
@@ -6,16 +7,109 @@
 
 namespace Multitude {
 
+MatrixSlice::MatrixSlice(std::vector<BlockSegment> segments, long cols)
+    : segments(segments), rows(0), cols(cols) {
+
+  for (auto const &segment : this->segments) {
+    startRows.push_back(rows);
+    rows += segment.getRows();
+  }
+}
+
+RowView MatrixSlice::row(long i) const {
+  if (i < 0 || i >= rows) {
+    throw std::out_of_range("row " + std::to_string(i) + " not in slice");
+  }
+
+  auto it = std::upper_bound(startRows.begin(), startRows.end(), i);
+  size_t idx = (it - startRows.begin()) - 1;
+  auto const &segment = segments[idx];
+  return {segment.getData() + (i - startRows[idx]) * cols, cols};
+}
+
 DMatrix::DMatrix(std::vector<std::shared_ptr<MemoryBlock>> memoryBlocks,
-                 std::vector<std::shared_ptr<RemoteBlock>> remoteBlocks) {
+                 std::vector<std::shared_ptr<RemoteBlock>> remoteBlocks,
+                 long cols)
+    : memoryBlocks(memoryBlocks), remoteBlocks(remoteBlocks), cols(cols) {
+  index();
+}
+
+void DMatrix::setMemoryBlocks(
+    std::vector<std::shared_ptr<MemoryBlock>> memoryBlocks) {
+  this->memoryBlocks = memoryBlocks;
+  index();
+}
+
+/**
+ * Rebuild the start row index of the memory blocks. Without memory
+ * blocks the column count is kept.
+ */
+void DMatrix::index() {
+  startRows.clear();
+  uniformRows = 0;
+  rows = 0;
 
-  for (auto block : memoryBlocks) {
-    this->memoryBlocks[block->getId()] = block;
+  if (!memoryBlocks.empty()) {
+    cols = memoryBlocks[0]->getBlockData().getCols();
+    uniformRows = memoryBlocks[0]->getBlockData().getRows();
   }
 
-  for (auto block : remoteBlocks) {
-    this->remoteBlocks[block->getId()] = block;
+  for (size_t i=0; i<memoryBlocks.size(); i++) {
+    long blockRows = memoryBlocks[i]->getBlockData().getRows();
+    startRows.push_back(rows);
+    rows += blockRows;
+
+    // Row lookups are a single division when every block but the
+    // last has the same number of rows (the common case for loads).
+    if (i + 1 < memoryBlocks.size() && blockRows != uniformRows) {
+      uniformRows = 0;
+    }
   }
 }
 
+size_t DMatrix::findBlock(long i) const {
+  if (i < 0 || i >= rows) {
+    throw std::out_of_range("row " + std::to_string(i) + " not in matrix");
+  }
+
+  if (uniformRows > 0) {
+    return std::min((size_t)(i / uniformRows), memoryBlocks.size() - 1);
+  }
+
+  auto it = std::upper_bound(startRows.begin(), startRows.end(), i);
+  return (it - startRows.begin()) - 1;
+}
+
+RowView DMatrix::row(long i) const {
+  size_t idx = findBlock(i);
+  auto const &blockData = memoryBlocks[idx]->getBlockData();
+  long offset = (i - startRows[idx]) * cols;
+  return {blockData.getData() + offset, cols};
+}
+
+MatrixSlice DMatrix::slice(long begin, long end) const {
+  if (begin < 0 || end > rows || begin > end) {
+    throw std::out_of_range("invalid slice [" + std::to_string(begin) + ", " +
+                            std::to_string(end) + ")");
+  }
+
+  std::vector<BlockSegment> segments;
+  if (begin == end) {
+    return {segments, cols};
+  }
+
+  for (size_t idx = findBlock(begin);
+       idx < memoryBlocks.size() && startRows[idx] < end; idx++) {
+    auto const &block = memoryBlocks[idx];
+    long blockRows = block->getBlockData().getRows();
+    long first = std::max(begin, startRows[idx]) - startRows[idx];
+    long last = std::min(end, startRows[idx] + blockRows) - startRows[idx];
+    if (last > first) {
+      segments.push_back(BlockSegment(block, first, last - first));
+    }
+  }
+
+  return {segments, cols};
+}
+
 }